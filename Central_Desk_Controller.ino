@@ -4,6 +4,9 @@
 #include <DHT.h>
 #include <FastLED.h>
 #include "animations.h"
+#include "power_limiter.h"
+#include "output_stage.h"
+#include "status_publisher.h"
 #include "FspTimer.h"
 #include <WiFiS3.h>
 #include <WiFiUdp.h>
@@ -18,7 +21,12 @@
 #define DHTTYPE DHT22
 #define RGB_COUNT 211
 #define COMPUTER_TRESHHOLD 200
+#define COMPUTER_HYSTERESIS 25     // the PC state only changes this far beyond the threshold, noise around it does not flap
 #define BLINKING_SPEED 250
+#define RGB_POWER_BUDGET_MA 3000  // what the desk PSU can spare for the strip
+#define SERIAL_RESERVE_STEP 256    // input grows in steps, an import line is several kB
+#define PC_SAMPLE_MS 50            // the PC state pin has no interrupt, sampled fast enough to stay below 100 ms latency
+#define DHT_SAMPLE_MS 2000         // DHT22 can not be read faster
 
 // ===== PIN DEFINITION =====
 
@@ -42,12 +50,30 @@ const char TOPIC_TEMP[] = "linus/haydn17/kellerzimmer/temperature";
 const char TOPIC_PC_HUMIDITY[] = "linus/haydn17/kellerzimmer/humidity";
 const char TOPIC_PC_CMD[] = "linus/haydn17/kellerzimmer/pc/command";
 const char TOPIC_PC_STATUS[] = "linus/haydn17/kellerzimmer/pc/status";
+const char TOPIC_PC_RELAY[] = "linus/haydn17/kellerzimmer/pc/relay";
 const char TOPIC_RGB_CMD[] = "linus/haydn17/kellerzimmer/rgb/command";
 const char TOPIC_RGB_STATUS[] = "linus/haydn17/kellerzimmer/rgb/status";
+const char TOPIC_RGB_BRIGHTNESS[] = "linus/haydn17/kellerzimmer/rgb/brightness";
+const char TOPIC_RGB_POWER[] = "linus/haydn17/kellerzimmer/rgb/power";
+const char TOPIC_RGB_LIMITER[] = "linus/haydn17/kellerzimmer/rgb/limiter";
+const char TOPIC_RGB_CATALOG[] = "linus/haydn17/kellerzimmer/rgb/catalog";
 const char TOPIC_AC_CMD[] = "linus/haydn17/kellerzimmer/ac/command";
 
-const long publish_interval = 1000;
-unsigned long last_publish = 0;
+// Status fields, published when their owner marks them dirty
+#define STATUS_PC 0
+#define STATUS_RELAY 1
+#define STATUS_RGB 2
+#define STATUS_BRIGHTNESS 3
+#define STATUS_POWER 4
+#define STATUS_LIMITER 5
+#define STATUS_TEMP 6
+#define STATUS_HUMIDITY 7
+#define STATUS_FIELD_COUNT 8
+
+const char* const status_topics[STATUS_FIELD_COUNT] = { TOPIC_PC_STATUS, TOPIC_PC_RELAY, TOPIC_RGB_STATUS, TOPIC_RGB_BRIGHTNESS,
+                                                        TOPIC_RGB_POWER, TOPIC_RGB_LIMITER, TOPIC_TEMP, TOPIC_PC_HUMIDITY };
+// Minimum time between two publishes of a field in ms
+const unsigned long status_min_interval[STATUS_FIELD_COUNT] = { 500, 0, 0, 250, 1000, 500, 5000, 5000 };
 
 // ===== NTP DEFINITIONS =====
 
@@ -71,6 +97,7 @@ const char* NTP_SERVER = "pool.ntp.org";
 
 bool pc_status = false;
 bool last_pc_status = false;
+bool relay_status = false;
 
 float temperature = 0;
 float last_temperature = 0;
@@ -85,16 +112,23 @@ IAnimation* user_animation = nullptr;
 int rgb_brightness = 0xFF;
 int last_rgb_brightness = 0xFF;
 bool flushRGB = false;
+unsigned long last_rgb_power = 0;
+bool last_rgb_limiting = false;
 
 unsigned long startEpoch = 0;
 
 Preferences prefs;
 FspTimer RGBTimer;
 CRGB leds[RGB_COUNT];
+CRGB rgb_frame[RGB_COUNT];   //copy of leds taken with interrupts off, RGBCallback keeps rendering into leds
+CRGB rgb_output[RGB_COUNT];
 WiFiClient wifiClient;
 WiFiUDP udp;
 DHT dht(dht_pin, DHTTYPE);
 AnimationManager animationManager(leds, RGB_COUNT, prefs);
+PowerLimiter powerLimiter(RGB_POWER_BUDGET_MA);
+OutputStage outputStage;
+StatusPublisher statusPublisher;
 MqttClient mqttClient(wifiClient);
 NTPClient timeClient(udp, NTP_SERVER, NTP_TIME_OFFSET, 60000);
 
@@ -108,14 +142,21 @@ void RGBCallback(timer_callback_args_t __attribute((unused)) * p_args);
 void UpdateRGB();
 void ConnectWifi();
 void ConnectMqtt();
-void PublishData();
+void PublishStatus();
+void PublishField(int field);
+void SampleInputs();
+void SetRelay(bool on);
 void UpdateMqtt();
 void OnMqttMessage();
 void handlePcCommand(String command);
-void handleRgbCommand(String command);
+void handleRgbCommand(String& command);
 void handleAcCommand(String command);
 void FireAnimation();
 void SerialIncome();
+int ParseHexBytes(String hex, uint8_t* out, int max_len);
+int SplitArgs(String command, String* args, int max_args);
+void BenchAnimation(IAnimation* animation, int frames);
+void PublishCatalog();
 
 
 void setup() {
@@ -130,6 +171,7 @@ void setup() {
   pinMode(pc_state_pin, INPUT);
   pinMode(relay_pin, OUTPUT);
 
+  for (int i = 0; i < STATUS_FIELD_COUNT; i++) statusPublisher.setMinInterval(i, status_min_interval[i]);
 
   attachInterrupt(key_pin, KeyChange, CHANGE);
   attachInterrupt(switch_pin, SwitchChange, CHANGE);
@@ -138,29 +180,13 @@ void setup() {
   IrSender.begin(IR_SEND_PIN);
 
   dht.begin();
-  FastLED.addLeds<WS2812B, led_pin, GRB>(leds, RGB_COUNT).setCorrection(TypicalLEDStrip);
+  FastLED.addLeds<WS2812B, led_pin, GRB>(rgb_output, RGB_COUNT).setCorrection(TypicalLEDStrip);
+  outputStage.setGamma(true);  // dithers as well, otherwise the dark end of the curve bands
 
   //Ensure that Animations that are needed by programm do exsist
   Serial.println("Setting up animations");
   animationManager.begin();
-
-  if (animationManager.getAnimationIndex("OFF") == -1) {
-    AnimationSetting* newSettings = animationManager.createSettingsStaticColor(0, 255, "OFF");
-    animationManager.createAnimation(newSettings);
-    delete newSettings;
-  }
-
-  if (animationManager.getAnimationIndex("RED") == -1) {
-    AnimationSetting* newSettings = animationManager.createSettingsStaticColor(0xFF0000, 255, "RED");
-    animationManager.createAnimation(newSettings);
-    delete newSettings;
-  }
-
-  if (animationManager.getAnimationIndex("SWITCH_BLINK") == -1) {
-    AnimationSetting* newSettings = animationManager.createSettingsBlink(0xFF0000, 0, 8, 255, "SWITCH_BLINK");
-    animationManager.createAnimation(newSettings);
-    delete newSettings;
-  }
+  animationManager.ensureDefaultAnimations();
   user_animation = animationManager.getAnimationByName("OFF");
   Serial.println("Done with animations");
 
@@ -178,6 +204,7 @@ void setup() {
 
 void loop() {
   SerialIncome();
+  SampleInputs();
   UpdateRGB();
   UpdateMqtt();
   WDT.refresh();
@@ -190,10 +217,30 @@ void UpdateRGB() {
     FastLED.setBrightness(rgb_brightness);
     last_rgb_brightness = rgb_brightness;
     flushRGB = true;
+    statusPublisher.markDirty(STATUS_BRIGHTNESS);
   }
   if (flushRGB) {
+    // Limiter and output work on the same frame, even if the timer renders the next one meanwhile
+    noInterrupts();
     flushRGB = false;
-    FastLED.show();
+    for (int i = 0; i < RGB_COUNT; i++) rgb_frame[i] = leds[i];
+    uint8_t brightness = FastLED.getBrightness();
+    interrupts();
+
+    uint32_t sum_r, sum_g, sum_b;
+    outputStage.sum(rgb_frame, RGB_COUNT, &sum_r, &sum_g, &sum_b);
+    uint8_t show_brightness = powerLimiter.apply(sum_r, sum_g, sum_b, RGB_COUNT, brightness);
+    FastLED.show(outputStage.render(rgb_frame, rgb_output, RGB_COUNT, show_brightness));
+
+    unsigned long rgb_power = powerLimiter.getEstimate();
+    if ((rgb_power > last_rgb_power ? rgb_power - last_rgb_power : last_rgb_power - rgb_power) >= 50) {
+      last_rgb_power = rgb_power;
+      statusPublisher.markDirty(STATUS_POWER);
+    }
+    if (powerLimiter.isLimiting() != last_rgb_limiting) {
+      last_rgb_limiting = powerLimiter.isLimiting();
+      statusPublisher.markDirty(STATUS_LIMITER);
+    }
   }
 }
 
@@ -203,12 +250,50 @@ void UpdateMqtt() {
     ConnectMqtt();
   }
   mqttClient.poll();
-  if (millis() - last_publish > publish_interval) {
-    last_publish = millis();
-    PublishData();
+  if (statusPublisher.pending()) PublishStatus();
+}
+
+// Reads the inputs that can not raise an interrupt and marks them when they changed
+void SampleInputs() {
+  static unsigned long last_pc_sample = 0;
+  static unsigned long last_dht_sample = 0;
+
+  if (millis() - last_pc_sample >= PC_SAMPLE_MS) {
+    last_pc_sample = millis();
+    int pc_level = analogRead(pc_state_pin);
+    if (pc_level > COMPUTER_TRESHHOLD + COMPUTER_HYSTERESIS) pc_status = true;
+    else if (pc_level < COMPUTER_TRESHHOLD - COMPUTER_HYSTERESIS) pc_status = false;
+    if (pc_status != last_pc_status) {
+      last_pc_status = pc_status;
+      statusPublisher.markDirty(STATUS_PC);
+    }
+  }
+
+  if (millis() - last_dht_sample >= DHT_SAMPLE_MS) {
+    last_dht_sample = millis();
+    temperature = dht.readTemperature();
+    humidity = dht.readHumidity();
+    if (isnan(temperature) || isnan(humidity)) {
+      //Failed to read DHT Data, dont publish garbage data
+      return;
+    }
+    if (temperature != last_temperature) {
+      last_temperature = temperature;
+      statusPublisher.markDirty(STATUS_TEMP);
+    }
+    if (humidity != last_humidity) {
+      last_humidity = humidity;
+      statusPublisher.markDirty(STATUS_HUMIDITY);
+    }
   }
 }
 
+void SetRelay(bool on) {
+  digitalWrite(relay_pin, on ? HIGH : LOW);
+  relay_status = on;
+  statusPublisher.markDirty(STATUS_RELAY);
+}
+
 void KeyChange() {
   if (digitalRead(key_pin)) {
     priority_animation = animationManager.getAnimationByName("RED");
@@ -227,8 +312,7 @@ void SwitchChange() {
 
 void ButtonChange() {
   if (digitalRead(switch_pin)) {
-    if (digitalRead(button_pin)) digitalWrite(relay_pin, HIGH);
-    else digitalWrite(relay_pin, LOW);
+    SetRelay(digitalRead(button_pin));
   }
   else
   {
@@ -241,6 +325,7 @@ void ButtonChange() {
       last_user_animation = user_animation;
       user_animation = animationManager.getAnimationByName("OFF");
     }
+    statusPublisher.markDirty(STATUS_RGB);
     }
   }
 }
@@ -257,6 +342,7 @@ void RGBCallback(timer_callback_args_t __attribute((unused)) * p_args) {
     flushRGB = true;
   }
   flushRGB |= active_animation->Update(cycle_counter);
+  flushRGB |= powerLimiter.isRamping();
 
   local_last_animation = active_animation;
   cycle_counter++;
@@ -267,6 +353,7 @@ void SerialIncome() {
   String input = "";
   while (Serial.available() > 0) {
     delayMicroseconds(90);
+    if (input.length() % SERIAL_RESERVE_STEP == 0) input.reserve(input.length() + SERIAL_RESERVE_STEP);
     char c = Serial.read();
     input += c;
   }
@@ -274,7 +361,7 @@ void SerialIncome() {
   input.trim();
   if (input.startsWith("rgb")) {
     if (input == "rgb") input = "";
-    else if (input.startsWith("rgb ")) input = input.substring(4);
+    else if (input.startsWith("rgb ")) input.remove(0, 4);
     handleRgbCommand(input);
   } else if (input.startsWith("dump")) {
     unsigned long runtime = timeClient.getEpochTime() - startEpoch;  // in Sekunden
@@ -282,7 +369,7 @@ void SerialIncome() {
     unsigned long minutes = (runtime % 3600) / 60;
     unsigned long seconds = runtime % 60;
     String runtimeStr = String(hours) + ":" + (minutes < 10 ? "0" : "") + minutes + ":" + (seconds < 10 ? "0" : "") + seconds;
-    String pc_state = (pc_state) ? "ON" : "OFF";
+    String pc_state = (pc_status) ? "ON" : "OFF";
     Serial.println(runtimeStr);
     Serial.print("Time: ");
     Serial.println(timeClient.getFormattedTime());
@@ -295,13 +382,42 @@ void SerialIncome() {
     Serial.print("PC Raw Value: ");
     Serial.println(analogRead(pc_state_pin));
     Serial.print("PC Treshold: ");
-    Serial.println(COMPUTER_TRESHHOLD);
+    Serial.print(COMPUTER_TRESHHOLD);
+    Serial.print(" +/- ");
+    Serial.println(COMPUTER_HYSTERESIS);
     Serial.print("RGB Programm: ");
     if (active_animation == nullptr) Serial.println("<nullptr>");
     else Serial.println(active_animation->GetName());
+    Serial.print("RGB Power: ");
+    Serial.print(powerLimiter.getEstimate());
+    Serial.print(" mA of ");
+    Serial.print(powerLimiter.getBudget());
+    Serial.println(" mA");
+    Serial.print("RGB Limiter: ");
+    Serial.print(powerLimiter.isLimiting() ? "active" : "inactive");
+    Serial.print(" (max brightness ");
+    Serial.print(powerLimiter.getLimit());
+    Serial.println(")");
+  } else if (input.startsWith("stats")) {
+    Serial.println("Topic: published / suppressed (merged into a pending publish) / delayed (min interval or burst limit)");
+    unsigned long suppressed = 0;
+    for (int i = 0; i < STATUS_FIELD_COUNT; i++) {
+      Serial.print(status_topics[i]);
+      Serial.print(": ");
+      Serial.print(statusPublisher.getPublished(i));
+      Serial.print(" / ");
+      Serial.print(statusPublisher.getSuppressed(i));
+      Serial.print(" / ");
+      Serial.println(statusPublisher.getDelayed(i));
+      suppressed += statusPublisher.getSuppressed(i);
+    }
+    Serial.print("Suppressed publishes: ");
+    Serial.println(suppressed);
+    if (input.indexOf("reset") > -1) statusPublisher.resetStats();
   } else if (input.startsWith("help")) {
     Serial.println("help - list of commands");
     Serial.println("dump - dump status and sensor data");
+    Serial.println("stats - publish statistics ('stats reset' clears them)");
     Serial.println("rgb - rgb application");
   } else {
     Serial.println("Unkown Command. Type 'help' for a list of commands");
@@ -309,18 +425,21 @@ void SerialIncome() {
 }
 
 void handlePcCommand(String command) {
+  // The pulse would be merged into a single "0" before the loop publishes again, send the edge right away
   if (command == "TOGGLE") {
-    digitalWrite(relay_pin, HIGH);
+    SetRelay(true);
+    PublishStatus();
     delay(1000);
-    digitalWrite(relay_pin, LOW);
+    SetRelay(false);
   } else if (command == "RESET") {
-    digitalWrite(relay_pin, HIGH);
+    SetRelay(true);
+    PublishStatus();
     WDT.refresh();
     delay(3000);
     WDT.refresh();
     delay(3000);
     WDT.refresh();
-    digitalWrite(relay_pin, LOW);
+    SetRelay(false);
   } else {
     Serial.print("Unknown PC command: ");
     Serial.println(command);
@@ -342,7 +461,8 @@ void handleAcCommand(String command)
   Serial.println(command);
 }
 
-void handleRgbCommand(String command) {
+// Takes the command by reference, an import carries the whole catalog and is parsed in place
+void handleRgbCommand(String& command) {
   Serial.println(command);
   if (command.startsWith("set") && !command.startsWith("setting")) {
     if (command == "set") {
@@ -356,6 +476,7 @@ void handleRgbCommand(String command) {
     } else {
       last_user_animation = user_animation;
       user_animation = animationManager.getAnimation(index);
+      statusPublisher.markDirty(STATUS_RGB);
       Serial.print("Switched to ");
       Serial.println(color);
     }
@@ -363,7 +484,7 @@ void handleRgbCommand(String command) {
     if (command.startsWith("new static ")) {
       command = command.substring(11);
       int spacePos = command.indexOf(' ');
-      if (spacePos == -1 || spacePos == 0 || spacePos >= command.length() - 1) {
+      if (spacePos == -1 || spacePos == 0 || spacePos >= (int)command.length() - 1) {
         Serial.println("Error: Format is 'new static NAME COLOR'");
         return;
       }
@@ -447,8 +568,85 @@ void handleRgbCommand(String command) {
       animationManager.createAnimation(newSettings);
       delete newSettings;
       Serial.println("New fade animation created!");
+    } else if (command.startsWith("new vm")) {
+      if (command == "new vm" || command == "new vm help") {
+        Serial.println("'new vm NAME PALETTE PROGRAM'\nPROGRAM: bytecode as hex string, see bytecode.h\nExample (moving rainbow): new vm rainbow 0 030103120416021001ff3000");
+        return;
+      }
+      command = command.substring(7);
+      int firstSpace = command.indexOf(' ');
+      int secondSpace = (firstSpace == -1) ? -1 : command.indexOf(' ', firstSpace + 1);
+      if (secondSpace == -1) {
+        Serial.println("Error: Missing arguments. Usage: 'new vm NAME PALETTE PROGRAM'");
+        return;
+      }
+
+      String name = command.substring(0, firstSpace);
+      uint8_t palette = (uint8_t)command.substring(firstSpace + 1, secondSpace).toInt();
+
+      uint8_t code[VM_MAX_PROGRAM];
+      int length = ParseHexBytes(command.substring(secondSpace + 1), code, VM_MAX_PROGRAM);
+      if (length <= 0) {
+        Serial.println("Error: Program is not a valid hex string or longer than " + String(VM_MAX_PROGRAM) + " bytes.");
+        return;
+      }
+      uint8_t ops = 0;
+      uint16_t cost = 0;
+      int error = BytecodeVM::verify(code, length, &ops, &cost);
+      if (error != VM_OK) {
+        Serial.print("Program rejected: ");
+        Serial.println(BytecodeVM::errorText(error));
+        return;
+      }
+
+      AnimationSetting* newSettings = animationManager.createSettingsBytecode(palette, 255, name);
+      if (newSettings == nullptr) {
+        Serial.println("Error: Name too long.");
+        return;
+      }
+      int index = animationManager.createBytecodeAnimation(newSettings, code, length);
+      delete newSettings;
+      if (index < 0) {
+        Serial.println("Error: Could not create animation.");
+        return;
+      }
+      Serial.print("New vm animation created! Worst case: ");
+      Serial.print(ops);
+      Serial.print(" instructions / ");
+      Serial.print(cost);
+      Serial.print(" cycles per pixel, ");
+      Serial.print((unsigned long)cost * RGB_COUNT);
+      Serial.print(" of ");
+      Serial.print(VM_FRAME_BUDGET);
+      Serial.println(" cycles per frame");
+    } else if (command.startsWith("new comet") || command.startsWith("new twinkle") || command.startsWith("new wave") || command.startsWith("new gradient")) {
+      // new TYPE NAME A B C
+      String args[5];
+      if (SplitArgs(command, args, 5) != 5) {
+        Serial.println("Usage:\n'new comet NAME COLOR SPEED FADE'\n'new twinkle NAME COLOR DENSITY FADE'\n'new wave NAME PALETTE SPEED LENGTH'\n'new gradient NAME COLOR_A COLOR_B SPEED'");
+        return;
+      }
+      String type = args[0];
+      String name = args[1];
+      AnimationSetting* newSettings = nullptr;
+      if (type == "comet") {
+        newSettings = animationManager.createSettingsComet(strtoul(args[2].c_str(), NULL, 16), args[3].toInt(), args[4].toInt(), 255, name);
+      } else if (type == "twinkle") {
+        newSettings = animationManager.createSettingsTwinkle(strtoul(args[2].c_str(), NULL, 16), args[3].toInt(), args[4].toInt(), 255, name);
+      } else if (type == "wave") {
+        newSettings = animationManager.createSettingsWave(args[2].toInt(), args[3].toInt(), args[4].toInt(), 255, name);
+      } else {
+        newSettings = animationManager.createSettingsGradient(strtoul(args[2].c_str(), NULL, 16), strtoul(args[3].c_str(), NULL, 16), args[4].toInt(), 255, name);
+      }
+      if (newSettings == nullptr) {
+        Serial.println("Error: Name too long.");
+        return;
+      }
+      animationManager.createAnimation(newSettings);
+      delete newSettings;
+      Serial.println("New " + type + " animation created!");
     } else {
-      Serial.println("'new' can be used to create an animation. \nUsage:\n'new static NAME COLOR'\n'new blink NAME COLOR_ON COLOR_OFF TICKS'\n'new fade NAME PALETTE SPEED DELTA'");
+      Serial.println("'new' can be used to create an animation. \nUsage:\n'new static NAME COLOR'\n'new blink NAME COLOR_ON COLOR_OFF TICKS'\n'new fade NAME PALETTE SPEED DELTA'\n'new comet NAME COLOR SPEED FADE'\n'new twinkle NAME COLOR DENSITY FADE'\n'new wave NAME PALETTE SPEED LENGTH'\n'new gradient NAME COLOR_A COLOR_B SPEED'\n'new vm NAME PALETTE PROGRAM'");
       return;
     }
   } else if (command.startsWith("setting")) {
@@ -459,7 +657,7 @@ void handleRgbCommand(String command) {
     int firstSpace = params.indexOf(' ');
 
     // Falls kein Parameter da ist
-    if (params.length() == -1) {
+    if (params.length() == 0) {
       Serial.println("Usage:\nsetting set NAME INDEX DATA\nsetting show NAME INDEX\nsetting list NAME");
       return;
     }
@@ -552,15 +750,60 @@ void handleRgbCommand(String command) {
       Serial.println("Unknown command. Usage:\nsetting set NAME INDEX DATA\nsetting show NAME INDEX\nsetting list NAME");
     }
   } else if (command == "list") {
+    // Deleted animations leave gaps, so every slot has to be looked at
     int amount = animationManager.getAnimationCount();
-    int i = 0;
-    while (i < 100 && amount > 0) {
+    for (int i = 0; i < 100 && amount > 0; i++) {
       IAnimation* ani = animationManager.getAnimation(i);
-      i++;
-      if (ani == nullptr) return;
+      if (ani == nullptr) continue;
       Serial.println(ani->GetName());
       amount--;
     }
+  } else if (command == "catalog") {
+    animationManager.exportCatalog(&Serial);
+    Serial.println();
+    PublishCatalog();
+  } else if (command.startsWith("import")) {
+    if (command == "import") {
+      Serial.println("'import' replaces all animations with a catalog from 'catalog'. \nUsage: 'import [{\"t\":TYPE,\"n\":\"NAME\",\"d\":\"DATA\"},...]'");
+      return;
+    }
+    // The animation objects get replaced, keep the selection by name
+    String user_name = (user_animation != nullptr) ? user_animation->GetName() : "OFF";
+    String last_name = (last_user_animation != nullptr) ? last_user_animation->GetName() : "";
+
+    // The RGB timer and the pin ISRs use and look up animations, keep them out while animations[] is rebuilt
+    RGBTimer.stop();
+    detachInterrupt(key_pin);
+    detachInterrupt(switch_pin);
+    detachInterrupt(button_pin);
+    active_animation = nullptr;
+    priority_animation = nullptr;
+    user_animation = nullptr;
+    last_user_animation = nullptr;
+    int count = animationManager.importCatalog(command.c_str() + 7);
+    // Same lookup on failure: nothing was replaced then and the names still resolve
+    user_animation = animationManager.getAnimationByName(user_name);
+    if (user_animation == nullptr) user_animation = animationManager.getAnimationByName("OFF");
+    last_user_animation = animationManager.getAnimationByName(last_name);
+    statusPublisher.markDirty(STATUS_RGB);
+    attachInterrupt(key_pin, KeyChange, CHANGE);
+    attachInterrupt(switch_pin, SwitchChange, CHANGE);
+    attachInterrupt(button_pin, ButtonChange, CHANGE);
+    SwitchChange();  // key and switch may have changed during the import
+    RGBTimer.start();
+
+    if (count < 0) {
+      Serial.print("Import failed: ");
+      if (count == -2) Serial.println("more than 100 animations, default animations included");
+      else if (count == -3) Serial.println("unknown animation type");
+      else if (count == -4) Serial.println("invalid bytecode program");
+      else if (count == -6) Serial.println("duplicate animation name");
+      else Serial.println("syntax error");
+      return;
+    }
+    Serial.print("Imported ");
+    Serial.print(count);
+    Serial.println(" animations");
   } else if (command == "toggle") {
     if (user_animation == animationManager.getAnimationByName("OFF")) {
       if (last_user_animation == nullptr || last_user_animation == animationManager.getAnimationByName("OFF")) user_animation = animationManager.getAnimationByName("WHITE");
@@ -569,6 +812,7 @@ void handleRgbCommand(String command) {
       last_user_animation = user_animation;
       user_animation = animationManager.getAnimationByName("OFF");
     }
+    statusPublisher.markDirty(STATUS_RGB);
   } else if (command.startsWith("delete")) {
     if (command == "delete") {
       Serial.println("'delete' can be used to delete an animation. \nUsage: 'delete ANIMATION'");
@@ -579,11 +823,70 @@ void handleRgbCommand(String command) {
     if (index == -1) {
       Serial.println("Animation not found");
     } else {
-      if (user_animation == animationManager.getAnimation(index)) user_animation = animationManager.getAnimationByName("OFF");
+      if (user_animation == animationManager.getAnimation(index)) {
+        user_animation = animationManager.getAnimationByName("OFF");
+        statusPublisher.markDirty(STATUS_RGB);
+      }
       animationManager.deleteAnimation(index);
       Serial.print("Deletet Animation ");
       Serial.println(color);
     }
+  } else if (command.startsWith("bench")) {
+    if (command == "bench") {
+      Serial.println("'bench' measures the render cost of an animation. \nUsage: 'bench ANIMATION [FRAMES]'");
+      return;
+    }
+    String args = command.substring(6);
+    int space = args.indexOf(' ');
+    String name = (space == -1) ? args : args.substring(0, space);
+    int frames = (space == -1) ? 100 : args.substring(space + 1).toInt();
+    if (frames <= 0) frames = 100;
+    IAnimation* anim = animationManager.getAnimationByName(name);
+    if (anim == nullptr) {
+      Serial.println("Animation not found");
+      return;
+    }
+    BenchAnimation(anim, frames);
+  } else if (command.startsWith("power")) {
+    if (command != "power") {
+      long budget = command.substring(6).toInt();
+      if (budget <= 0) {
+        Serial.println("Usage: 'power' shows the estimate, 'power BUDGET_MA' sets the budget");
+        return;
+      }
+      powerLimiter.setBudget(budget);
+      flushRGB = true;
+    }
+    Serial.print("Estimate: ");
+    Serial.print(powerLimiter.getEstimate());
+    Serial.print(" mA, Budget: ");
+    Serial.print(powerLimiter.getBudget());
+    Serial.print(" mA, Limiter: ");
+    Serial.println(powerLimiter.isLimiting() ? "active" : "inactive");
+  } else if (command.startsWith("output")) {
+    if (command.startsWith("output gamma ")) {
+      outputStage.setGamma(command.indexOf("ON") > -1);
+      flushRGB = true;
+    } else if (command.startsWith("output dither ")) {
+      outputStage.setDither(command.indexOf("ON") > -1);
+      flushRGB = true;
+    } else if (command != "output") {
+      Serial.println("Usage: 'output' shows the output stage, 'output gamma ON/OFF' (ON also dithers), 'output dither ON/OFF' (OFF also ends gamma)");
+      return;
+    }
+    Serial.print("Gamma: ");
+    Serial.println(outputStage.isGamma() ? "ON" : "OFF");
+    Serial.print("Dither: ");
+    Serial.println(outputStage.isDithering() ? "ON" : "OFF");
+    Serial.print("Show: interrupts masked for ");
+    Serial.print(LED_WIRE_US(RGB_COUNT));
+    Serial.println(" us");
+    Serial.print("Cost: ");
+    Serial.print(outputStage.getLastMicros());
+    Serial.print(" us last, ");
+    Serial.print(outputStage.getMaxMicros());
+    Serial.println(" us max per output frame");
+    outputStage.resetStats();
   } else if(command.startsWith("brightness")){
     if(command=="brightness")
     {
@@ -599,12 +902,93 @@ void handleRgbCommand(String command) {
     
   }
   else if (command == "help") {
-    Serial.print("help - list of commands\nset - set an Animation\nnew - create new animation\nlist - list all Animations\ntoggle - Turn light on/off\nsettings - change setting of Animation\ndelete - delete Animation\n");
+    Serial.print("help - list of commands\nset - set an Animation\nnew - create new animation\nlist - list all Animations\ntoggle - Turn light on/off\nsettings - change setting of Animation\ndelete - delete Animation\ncatalog - export all Animations as JSON\nimport - replace all Animations with a catalog\nbench - measure render cost of Animation\npower - show power estimate / set budget\noutput - gamma/dither settings and cost\n");
   } else {
     Serial.println("Unkown Command. Type 'help' for a list of commands");
   }
 }
 
+int ParseHexBytes(String hex, uint8_t* out, int max_len) {
+  hex.trim();
+  if (hex.length() % 2 != 0 || (int)hex.length() / 2 > max_len) return -1;
+  for (unsigned int i = 0; i < hex.length(); i += 2) {
+    char byte_str[3] = { hex[i], hex[i + 1], 0 };
+    char* end = nullptr;
+    out[i / 2] = (uint8_t)strtoul(byte_str, &end, 16);
+    if (*end != 0) return -1;
+  }
+  return hex.length() / 2;
+}
+
+// Splits "new TYPE ARG ARG ..." into its arguments after "new", returns the number found.
+int SplitArgs(String command, String* args, int max_args) {
+  int count = 0;
+  int start = command.indexOf(' ') + 1;
+  while (start > 0 && start < (int)command.length() && count < max_args) {
+    int end = command.indexOf(' ', start);
+    if (end == -1) end = command.length();
+    if (end > start) args[count++] = command.substring(start, end);
+    start = end + 1;
+  }
+  return count;
+}
+
+// Publishes the catalog without building it in memory: the length is computed first and passed up front,
+// so the client streams the entries instead of going through its 256 byte buffer.
+void PublishCatalog() {
+  if (!mqttClient.connected()) return;
+  mqttClient.beginMessage(TOPIC_RGB_CATALOG, animationManager.exportCatalog(nullptr), true, 1);
+  animationManager.exportCatalog(&mqttClient);
+  mqttClient.endMessage();
+}
+
+// Renders FRAMES frames of an animation with the RGB timer stopped and reports the cost per frame and per pixel.
+void BenchAnimation(IAnimation* animation, int frames) {
+  RGBTimer.stop();
+  animation->RestartAnimation();
+
+  unsigned long total = 0;
+  unsigned long worst = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    unsigned long start = micros();
+    animation->Update(frame);
+    unsigned long duration = micros() - start;
+    total += duration;
+    if (duration > worst) worst = duration;
+    if (frame % 50 == 0) WDT.refresh();
+  }
+
+  unsigned long cycles_per_us = F_CPU / 1000000;
+  Serial.print("Frames: ");
+  Serial.println(frames);
+  Serial.print("Average: ");
+  Serial.print(total / frames);
+  Serial.print(" us/frame, ");
+  Serial.print(total * cycles_per_us / ((unsigned long)frames * RGB_COUNT));
+  Serial.println(" cycles/pixel");
+  Serial.print("Worst case: ");
+  Serial.print(worst);
+  Serial.print(" us/frame, ");
+  Serial.print(worst * cycles_per_us);
+  Serial.println(" cycles/frame");
+
+  // For calibrating vm_opcost: bench a program that is made mostly of one opcode and compare
+  AnimationSetting settings;
+  animation->getAnimationSetting(&settings);
+  if (settings.type == BYTECODE) {
+    unsigned long weighted = ((BytecodeAnimation*)animation)->GetVM()->getFrameCost(RGB_COUNT);
+    Serial.print("Weighted (vm_opcost): ");
+    Serial.print(weighted);
+    Serial.print(" cycles/frame, measured average is ");
+    Serial.print(total * cycles_per_us * 100 / ((unsigned long)frames * weighted));
+    Serial.println("% of it");
+  }
+
+  if (active_animation != nullptr) active_animation->RestartAnimation();
+  flushRGB = true;
+  RGBTimer.start();
+}
+
 bool BeginRGBTimer(float rate) {
   uint8_t timer_type = GPT_TIMER;
   int8_t tindex = FspTimer::get_available_timer(timer_type);
@@ -638,6 +1022,7 @@ bool BeginRGBTimer(float rate) {
 void OnMqttMessage(int messageSize) {
   String topic = mqttClient.messageTopic();
   String payload = "";
+  payload.reserve(messageSize);  // catalogs are several kB, growing byte by byte would fragment the heap
   while (mqttClient.available()) {
     payload += (char)mqttClient.read();
   }
@@ -660,49 +1045,28 @@ void OnMqttMessage(int messageSize) {
   }
 }
 
-void PublishData() {
-  static IAnimation* local_last_animation = nullptr;
-
-  // ===== Collect Data =====
-
-  pc_status = (analogRead(pc_state_pin) > COMPUTER_TRESHHOLD) ? true : false;
-  temperature = dht.readTemperature();
-  humidity = dht.readHumidity();
-
-  // ===== Publish Data =====
-
-  if (pc_status != last_pc_status) {
-    last_pc_status = pc_status;
-    mqttClient.beginMessage(TOPIC_PC_STATUS, true, 1);  // topic, retained, qos
-    mqttClient.print(pc_status);
-    mqttClient.endMessage();
-  }
-
-  if (user_animation != local_last_animation) {
-    local_last_animation = user_animation;
-    mqttClient.beginMessage(TOPIC_RGB_STATUS, true, 1);  // topic, retained, qos
-    mqttClient.print(user_animation->GetName());
-    mqttClient.endMessage();
-  }
-
-  if (isnan(temperature) || isnan(humidity)) {
-    //Failed to read DHT Data, dont publish garbage data
-    return;
-  }
-
-  if (temperature != last_temperature) {
-    last_temperature = temperature;
-    mqttClient.beginMessage(TOPIC_TEMP, false, 0);  // topic, retained, qos
-    mqttClient.print(temperature);
-    mqttClient.endMessage();
+// Publishes the current value of every dirty field that is due
+void PublishStatus() {
+  int field;
+  while ((field = statusPublisher.next(millis())) != -1) {
+    PublishField(field);
   }
+}
 
-  if (abs(humidity - last_humidity) != 0) {
-    last_humidity = humidity;
-    mqttClient.beginMessage(TOPIC_PC_HUMIDITY, false, 0);
-    mqttClient.print(humidity);
-    mqttClient.endMessage();
+void PublishField(int field) {
+  bool retained = field != STATUS_POWER && field != STATUS_TEMP && field != STATUS_HUMIDITY;
+  mqttClient.beginMessage(status_topics[field], retained, retained ? 1 : 0);  // topic, retained, qos
+  switch (field) {
+    case STATUS_PC: mqttClient.print(pc_status); break;
+    case STATUS_RELAY: mqttClient.print(relay_status); break;
+    case STATUS_RGB: mqttClient.print((user_animation == nullptr) ? "" : user_animation->GetName()); break;
+    case STATUS_BRIGHTNESS: mqttClient.print(rgb_brightness); break;
+    case STATUS_POWER: mqttClient.print(powerLimiter.getEstimate()); break;
+    case STATUS_LIMITER: mqttClient.print(powerLimiter.isLimiting()); break;
+    case STATUS_TEMP: mqttClient.print(temperature); break;
+    case STATUS_HUMIDITY: mqttClient.print(humidity); break;
   }
+  mqttClient.endMessage();
 }
 
 void ConnectMqtt() {
@@ -725,6 +1089,9 @@ void ConnectMqtt() {
   mqttClient.subscribe(TOPIC_PC_CMD, 2);
   mqttClient.subscribe(TOPIC_RGB_CMD, 2);
   mqttClient.subscribe(TOPIC_AC_CMD, 2);
+
+  // The broker may have lost the retained values, send the whole state once
+  statusPublisher.markAll();
 }
 
 void ConnectWifi() {
@@ -6,6 +6,17 @@
 #define STATIC_COLOR 1
 #define BLINK 2
 #define PALETTE 3
+#define BYTECODE 4
+#define COMET 5
+#define TWINKLE 6
+#define WAVE 7
+#define GRADIENT 8
+
+#define CATALOG_ENTRY_SIZE 224 //longest catalog entry: escaped 13 char name, 16 data and 64 program bytes as hex
+#define DEFAULT_ANIMATION_COUNT 3
+
+#include "lookup_tables.h"
+#include "bytecode.h"
 
 typedef struct{
     uint8_t id;
@@ -333,19 +344,22 @@ public:
     void ChangePalette(uint8_t id)
     {
         paletteID = id;
+        currentPalette = GetPalette(id);
+    }
+
+    static CRGBPalette16 GetPalette(uint8_t id)
+    {
         switch(id)
         {
-            case 0: currentPalette = RainbowColors_p; break;
-            case 1: currentPalette = PartyColors_p; break;
-            case 2: currentPalette = OceanColors_p; break;     // Blau/Weiß/Türkis
-            case 3: currentPalette = ForestColors_p; break;    // Grün/Braun
-            case 4: currentPalette = HeatColors_p; break;      // Rot/Gelb/Weiß (Feuer)
-            case 5: currentPalette = LavaColors_p; break;      // Rot/Schwarz/Orange
+            case 0: return RainbowColors_p;
+            case 1: return PartyColors_p;
+            case 2: return OceanColors_p;     // Blau/Weiß/Türkis
+            case 3: return ForestColors_p;    // Grün/Braun
+            case 4: return HeatColors_p;      // Rot/Gelb/Weiß (Feuer)
+            case 5: return LavaColors_p;      // Rot/Schwarz/Orange
             // Eigene Palette (Beispiel: Matrix grün)
-            case 6: 
-                currentPalette = CRGBPalette16(CRGB::Black, CRGB::Green, CRGB::Black, CRGB::DarkGreen);
-                break;
-            default: currentPalette = RainbowColors_p; break;
+            case 6: return CRGBPalette16(CRGB::Black, CRGB::Green, CRGB::Black, CRGB::DarkGreen);
+            default: return RainbowColors_p;
         }
     }
 
@@ -444,158 +458,950 @@ private:
     bool update_needed = false;
 };
 
-class AnimationManager
+// The following animations are written for frame rates up to 60 Hz: integer math only, no divides per frame,
+// sine/easing from lookup_tables.h and state that is carried from frame to frame instead of recomputed.
+// The costs noted below are host-relative only: average Update() time on the host bench (make -C host run),
+// as a multiple of a WaveAnimation frame. They are no board figures, cycles per frame on the UNO R4 come from
+// 'rgb bench NAME' and have not been recorded yet.
+
+// Host-relative cost: about 0.2x a wave frame
+class CometAnimation : public IAnimation
 {
-    public: 
-        AnimationManager(struct CRGB *targetArray_, int RGBCount_, Preferences& storage)
-        {
-            leds = targetArray_;
-            rgb_count = RGBCount_;
-            _storage = storage;
-        }
+public:
+    CometAnimation(struct CRGB *targetArray, int RGBCount)
+    {
+        leds = targetArray;
+        rgb_count = RGBCount;
+        strip_end = (uint16_t)(RGBCount << 8);
+    }
 
-        void begin()
-        {
-            memset(animations, 0, sizeof(animations));
-            animation_count = createAnimationsFromStorage();
-        }
+    void ResetSettings() override
+    {
+        brightness = 255;
+        color = 0xFFFFFF;
+        speed = 64;
+        fade = 40;
+    }
 
-        ~AnimationManager(){};
+    void RestartAnimation() override
+    {
+        position = 0;
+        fill_solid(leds, rgb_count, CRGB::Black);
+        FastLED.setBrightness(brightness);
+    }
 
-        int getAnimationIndex(String name)
-        {
-            int i = 0;
-            while(i < 100)
-            {
-                if (animations[i] != nullptr && name == animations[i]->GetName())break;
-                i++;
-            }
-            //Serial.println(i);
-            if(i < 100)return i;
-            else return -1;
-        }
+    bool Update(unsigned long tick) override
+    {
+        // The tail is what is left of the previous frames
+        nscale8(leds, rgb_count, 255 - fade);
 
-        IAnimation* getAnimation(int index)
-        {
-            if(index < 0 || index >= 100)return nullptr;
-            else return animations[index];
-        }
+        // Position is 8.8 fixed point, speed is in 1/16 pixel per frame
+        position += (uint16_t)speed << 4;
+        if(position >= strip_end) position -= strip_end;
 
-        IAnimation* getAnimationByName(String name)
-        {
-            int id = getAnimationIndex(name);
-            if(id==-1)return nullptr;
-            else return animations[id];
-        }
-        
-        int createAnimation(AnimationSetting* settings, bool save)
-        {
-            if(settings == nullptr)return -1;
+        uint16_t index = position >> 8;
+        uint8_t frac = position & 0xFF;
+        uint16_t next = index + 1;
+        if(next >= rgb_count) next = 0;
 
-            int i = 0;
-            while(i<100&&animations[i]!=nullptr) i++;
-            if (i>=100) return -2;
+        CRGB head = CRGB(color);
+        leds[index] += CRGB(head).nscale8(255 - frac);
+        leds[next] += head.nscale8(frac);
 
-            IAnimation* animation = nullptr;
-            if(settings->type==STATIC_COLOR)
-            {
-                animation = new StaticColorAnimation(leds, rgb_count);
-            }
-            else if(settings->type==BLINK)
-            {
-                animation = new BlinkAnimation(leds, rgb_count);
-            }
-            else if(settings->type == PALETTE)
-            {
-                animation = new PaletteAnimation(leds, rgb_count);
-            }
-            else return -3;
-            settings->id = i;
-            animation->applyAnimationSetting(settings);
-            if(save)saveAnimation(settings);
-            animations[i]=animation;
-            animation_count++;
-            return i;
+        if(FastLED.getBrightness() != brightness) {
+            FastLED.setBrightness(brightness);
         }
+        return true;
+    }
 
-        int createAnimation(AnimationSetting* settings)
+    bool UpdateSetting(int index, unsigned long value) override
+    {
+        switch(index)
         {
-            createAnimation(settings, true);
+            case 0:
+                if(value > 0xFFFFFF) return false;
+                color = value;
+                break;
+            case 1:
+                if(value > 255) return false;
+                speed = (uint8_t)value;
+                break;
+            case 2:
+                if(value > 255) return false;
+                fade = (uint8_t)value;
+                break;
+            case 3:
+                if(value > 255) return false;
+                brightness = (uint8_t)value;
+                break;
+            default:
+                return false;
         }
-        void saveAnimation(AnimationSetting* settings)
+        return true;
+    }
+
+    int GetSetting(int index) override
+    {
+        switch(index)
         {
-            _storage.begin("anim_data");
-            String key = "a"+ String(settings->id);
-            _storage.putBytes(key.c_str(),settings,sizeof(AnimationSetting));
-            _storage.end();
+            case 0: return color;
+            case 1: return speed;
+            case 2: return fade;
+            case 3: return brightness;
+            default: return -1;
         }
+    }
 
-        bool saveAnimationIndex(int id)
+    String GetAvailableSettings() override
+    {
+        return "0: Color\n1: Speed in 1/16 pixel per frame\n2: Tail fade per frame\n3: Brightness";
+    }
+
+    String GetName() override
+    {
+        return name;
+    }
+
+    void getAnimationSetting(AnimationSetting* settings) override
+    {
+        settings->id = id;
+        settings->type = COMET;
+
+        memset(settings->name, 0, sizeof(settings->name));
+        int len = name.length();
+        if (len > 13) len = 13;
+        memcpy(settings->name, name.c_str(), len);
+
+        settings->data[0] = brightness;
+        settings->data[1] = (uint8_t)(color & 0xFF);
+        settings->data[2] = (uint8_t)((color >> 8) & 0xFF);
+        settings->data[3] = (uint8_t)((color >> 16) & 0xFF);
+        settings->data[4] = speed;
+        settings->data[5] = fade;
+    }
+
+    void applyAnimationSetting(AnimationSetting* settings) override
+    {
+        id = settings->id;
+        name = String(settings->name, strnlen(settings->name, 13));
+
+        brightness = settings->data[0];
+        color = 0;
+        color |= settings->data[1];
+        color |= (((unsigned long)settings->data[2]) << 8);
+        color |= (((unsigned long)settings->data[3]) << 16);
+        speed = settings->data[4];
+        fade = settings->data[5];
+    }
+
+private:
+    uint8_t id = 0;
+    String name = "";
+    CRGB *leds;
+    int rgb_count;
+
+    uint8_t brightness = 255;
+    unsigned long color = 0xFFFFFF;
+    uint8_t speed = 64;
+    uint8_t fade = 40;
+
+    uint16_t position = 0;
+    uint16_t strip_end;
+};
+
+// Host-relative cost: about 0.2x a wave frame
+class TwinkleAnimation : public IAnimation
+{
+public:
+    TwinkleAnimation(struct CRGB *targetArray, int RGBCount)
+    {
+        leds = targetArray;
+        rgb_count = RGBCount;
+    }
+
+    void ResetSettings() override
+    {
+        brightness = 255;
+        color = 0xFFFFFF;
+        density = 64;
+        fade = 20;
+    }
+
+    void RestartAnimation() override
+    {
+        fill_solid(leds, rgb_count, CRGB::Black);
+        FastLED.setBrightness(brightness);
+    }
+
+    bool Update(unsigned long tick) override
+    {
+        nscale8(leds, rgb_count, 255 - fade);
+
+        // density/32 new twinkles per frame, the remainder as probability
+        uint8_t spawn = density >> 5;
+        if(random8() < (uint8_t)((density & 0x1F) << 3)) spawn++;
+
+        CRGB spark = CRGB(color);
+        while(spawn--)
         {
-            if(id < 0 || id >= 100)return false;
-            if (animations[id] == nullptr) return false;
-            AnimationSetting settings;
-            animations[id]->getAnimationSetting(&settings);
-            saveAnimation(&settings);
-            return true;
+            leds[random16(rgb_count)] = spark;
         }
 
-        void deleteAnimation(int id)
-        {
-            if(id < 0 || id >= 100)return;
-            String key = "a" + String(id);
-            _storage.begin("anim_data", false);
-            _storage.remove(key.c_str()); 
-            _storage.end();
-            delete animations[id];
-            animations[id]=nullptr;
-            animation_count--;
+        if(FastLED.getBrightness() != brightness) {
+            FastLED.setBrightness(brightness);
         }
+        return true;
+    }
 
-        int createAnimationsFromStorage()
+    bool UpdateSetting(int index, unsigned long value) override
+    {
+        switch(index)
         {
-            String key = "";
-            int found = 0;
-            for (int i = 0; i < 100; i++)
-            {
-                key = "a" + String(i);
-                AnimationSetting tempSettings;
-                _storage.begin("anim_data", false);
-                size_t len = _storage.getBytes(key.c_str(), &tempSettings, sizeof(AnimationSetting));
-                if (len == sizeof(AnimationSetting)) 
-                {   
-                    createAnimation(&tempSettings, false);
-                    found++;
-                }
-                _storage.end();
-            }
-            return found;
+            case 0:
+                if(value > 0xFFFFFF) return false;
+                color = value;
+                break;
+            case 1:
+                if(value > 255) return false;
+                density = (uint8_t)value;
+                break;
+            case 2:
+                if(value > 255) return false;
+                fade = (uint8_t)value;
+                break;
+            case 3:
+                if(value > 255) return false;
+                brightness = (uint8_t)value;
+                break;
+            default:
+                return false;
         }
+        return true;
+    }
 
-        AnimationSetting* createSettingsStaticColor(unsigned long color, uint8_t brightness, String name)
+    int GetSetting(int index) override
+    {
+        switch(index)
         {
-            if (name.length()>13)return nullptr;
-            AnimationSetting* settings = new AnimationSetting();
-            settings->type = STATIC_COLOR;
-            memcpy(settings->name, name.c_str(), name.length());
-            settings->data[0] = brightness;
-            settings->data[1] = (uint8_t)(color & 0xFF);
-            settings->data[2] = (uint8_t)((color >> 8) & 0xFF);
-            settings->data[3] = (uint8_t)((color >> 16) & 0xFF);
-            return settings;
+            case 0: return color;
+            case 1: return density;
+            case 2: return fade;
+            case 3: return brightness;
+            default: return -1;
         }
+    }
 
-        AnimationSetting* createSettingsBlink(unsigned long color_on, unsigned long color_off, uint8_t cycle_ticks, uint8_t brightness, String name)
-        {
-            if (name.length()>13)return nullptr;
-            AnimationSetting* settings = new AnimationSetting();
-            settings->type = BLINK;
-            memcpy(settings->name, name.c_str(), name.length());
-            settings->data[0] = brightness;
-            settings->data[1] = (uint8_t)(color_on & 0xFF);
-            settings->data[2] = (uint8_t)((color_on >> 8) & 0xFF);
-            settings->data[3] = (uint8_t)((color_on >> 16) & 0xFF);
-            settings->data[4] = (uint8_t)(color_off & 0xFF);
+    String GetAvailableSettings() override
+    {
+        return "0: Color\n1: Density (new twinkles per frame * 32)\n2: Fade per frame\n3: Brightness";
+    }
+
+    String GetName() override
+    {
+        return name;
+    }
+
+    void getAnimationSetting(AnimationSetting* settings) override
+    {
+        settings->id = id;
+        settings->type = TWINKLE;
+
+        memset(settings->name, 0, sizeof(settings->name));
+        int len = name.length();
+        if (len > 13) len = 13;
+        memcpy(settings->name, name.c_str(), len);
+
+        settings->data[0] = brightness;
+        settings->data[1] = (uint8_t)(color & 0xFF);
+        settings->data[2] = (uint8_t)((color >> 8) & 0xFF);
+        settings->data[3] = (uint8_t)((color >> 16) & 0xFF);
+        settings->data[4] = density;
+        settings->data[5] = fade;
+    }
+
+    void applyAnimationSetting(AnimationSetting* settings) override
+    {
+        id = settings->id;
+        name = String(settings->name, strnlen(settings->name, 13));
+
+        brightness = settings->data[0];
+        color = 0;
+        color |= settings->data[1];
+        color |= (((unsigned long)settings->data[2]) << 8);
+        color |= (((unsigned long)settings->data[3]) << 16);
+        density = settings->data[4];
+        fade = settings->data[5];
+    }
+
+private:
+    uint8_t id = 0;
+    String name = "";
+    CRGB *leds;
+    int rgb_count;
+
+    uint8_t brightness = 255;
+    unsigned long color = 0xFFFFFF;
+    uint8_t density = 64;
+    uint8_t fade = 20;
+};
+
+// Host-relative cost: 1x (reference, the most expensive effect)
+class WaveAnimation : public IAnimation
+{
+public:
+    WaveAnimation(struct CRGB *targetArray, int RGBCount)
+    {
+        leds = targetArray;
+        rgb_count = RGBCount;
+        currentPalette = RainbowColors_p;
+        initLookupTables();
+    }
+
+    void ResetSettings() override
+    {
+        brightness = 255;
+        paletteID = 0;
+        speed = 16;
+        wavelength = 32;
+        currentPalette = RainbowColors_p;
+    }
+
+    void RestartAnimation() override
+    {
+        phase = 0;
+        FastLED.setBrightness(brightness);
+    }
+
+    bool Update(unsigned long tick) override
+    {
+        // Phases are 8.8 fixed point, the per pixel phase is accumulated instead of multiplied
+        phase += (uint16_t)speed << 4;
+        uint16_t pixel_phase = phase;
+        uint16_t step = (uint16_t)wavelength << 4;
+        uint8_t hue = phase >> 10;
+
+        for(int i = 0; i < rgb_count; i++)
+        {
+            uint8_t angle = pixel_phase >> 8;
+            leds[i] = ColorFromPalette(currentPalette, hue + angle, sine8_lut[angle], LINEARBLEND);
+            pixel_phase += step;
+        }
+
+        if(FastLED.getBrightness() != brightness) {
+            FastLED.setBrightness(brightness);
+        }
+        return true;
+    }
+
+    bool UpdateSetting(int index, unsigned long value) override
+    {
+        switch(index)
+        {
+            case 0:
+                if(value > 255) return false;
+                paletteID = (uint8_t)value;
+                currentPalette = PaletteAnimation::GetPalette(paletteID);
+                break;
+            case 1:
+                if(value > 255) return false;
+                speed = (uint8_t)value;
+                break;
+            case 2:
+                if(value > 255) return false;
+                wavelength = (uint8_t)value;
+                break;
+            case 3:
+                if(value > 255) return false;
+                brightness = (uint8_t)value;
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    int GetSetting(int index) override
+    {
+        switch(index)
+        {
+            case 0: return paletteID;
+            case 1: return speed;
+            case 2: return wavelength;
+            case 3: return brightness;
+            default: return -1;
+        }
+    }
+
+    String GetAvailableSettings() override
+    {
+        return "0: Palette ID (0=Rainbow, 1=Party, 2=Ocean, 3=Forest, 4=Heat, 5=Lava, 6=Matrix)\n1: Speed\n2: Wave density (phase per pixel)\n3: Brightness";
+    }
+
+    String GetName() override
+    {
+        return name;
+    }
+
+    void getAnimationSetting(AnimationSetting* settings) override
+    {
+        settings->id = id;
+        settings->type = WAVE;
+
+        memset(settings->name, 0, sizeof(settings->name));
+        int len = name.length();
+        if (len > 13) len = 13;
+        memcpy(settings->name, name.c_str(), len);
+
+        settings->data[0] = brightness;
+        settings->data[1] = paletteID;
+        settings->data[2] = speed;
+        settings->data[3] = wavelength;
+    }
+
+    void applyAnimationSetting(AnimationSetting* settings) override
+    {
+        id = settings->id;
+        name = String(settings->name, strnlen(settings->name, 13));
+
+        brightness = settings->data[0];
+        paletteID = settings->data[1];
+        speed = settings->data[2];
+        wavelength = settings->data[3];
+        currentPalette = PaletteAnimation::GetPalette(paletteID);
+    }
+
+private:
+    uint8_t id = 0;
+    String name = "";
+    CRGB *leds;
+    int rgb_count;
+
+    CRGBPalette16 currentPalette;
+    uint8_t brightness = 255;
+    uint8_t paletteID = 0;
+    uint8_t speed = 16;
+    uint8_t wavelength = 32;
+
+    uint16_t phase = 0;
+};
+
+// Host-relative cost: about 0.4x a wave frame
+class GradientAnimation : public IAnimation
+{
+public:
+    GradientAnimation(struct CRGB *targetArray, int RGBCount)
+    {
+        leds = targetArray;
+        rgb_count = RGBCount;
+        // One triangle period (A -> B -> A) over the whole strip, the only divide happens here
+        step = (uint16_t)(0x10000UL / RGBCount);
+        initLookupTables();
+    }
+
+    void ResetSettings() override
+    {
+        brightness = 255;
+        color_a = 0xFF0000;
+        color_b = 0x0000FF;
+        speed = 8;
+    }
+
+    void RestartAnimation() override
+    {
+        offset = 0;
+        drawn = false;
+        FastLED.setBrightness(brightness);
+    }
+
+    bool Update(unsigned long tick) override
+    {
+        if(speed == 0 && drawn) return false; //static gradient is already on the strip
+
+        offset += (uint16_t)speed << 4;
+        CRGB a = CRGB(color_a);
+        CRGB b = CRGB(color_b);
+        uint16_t pos = offset;
+
+        for(int i = 0; i < rgb_count; i++)
+        {
+            leds[i] = blend(a, b, ease8_lut[triangle8(pos >> 8)]);
+            pos += step;
+        }
+        drawn = true;
+
+        if(FastLED.getBrightness() != brightness) {
+            FastLED.setBrightness(brightness);
+        }
+        return true;
+    }
+
+    bool UpdateSetting(int index, unsigned long value) override
+    {
+        switch(index)
+        {
+            case 0:
+                if(value > 0xFFFFFF) return false;
+                color_a = value;
+                break;
+            case 1:
+                if(value > 0xFFFFFF) return false;
+                color_b = value;
+                break;
+            case 2:
+                if(value > 255) return false;
+                speed = (uint8_t)value;
+                break;
+            case 3:
+                if(value > 255) return false;
+                brightness = (uint8_t)value;
+                break;
+            default:
+                return false;
+        }
+        drawn = false;
+        return true;
+    }
+
+    int GetSetting(int index) override
+    {
+        switch(index)
+        {
+            case 0: return color_a;
+            case 1: return color_b;
+            case 2: return speed;
+            case 3: return brightness;
+            default: return -1;
+        }
+    }
+
+    String GetAvailableSettings() override
+    {
+        return "0: Color A\n1: Color B\n2: Speed (0 = static)\n3: Brightness";
+    }
+
+    String GetName() override
+    {
+        return name;
+    }
+
+    void getAnimationSetting(AnimationSetting* settings) override
+    {
+        settings->id = id;
+        settings->type = GRADIENT;
+
+        memset(settings->name, 0, sizeof(settings->name));
+        int len = name.length();
+        if (len > 13) len = 13;
+        memcpy(settings->name, name.c_str(), len);
+
+        settings->data[0] = brightness;
+        settings->data[1] = (uint8_t)(color_a & 0xFF);
+        settings->data[2] = (uint8_t)((color_a >> 8) & 0xFF);
+        settings->data[3] = (uint8_t)((color_a >> 16) & 0xFF);
+        settings->data[4] = (uint8_t)(color_b & 0xFF);
+        settings->data[5] = (uint8_t)((color_b >> 8) & 0xFF);
+        settings->data[6] = (uint8_t)((color_b >> 16) & 0xFF);
+        settings->data[7] = speed;
+    }
+
+    void applyAnimationSetting(AnimationSetting* settings) override
+    {
+        id = settings->id;
+        name = String(settings->name, strnlen(settings->name, 13));
+
+        brightness = settings->data[0];
+        color_a = 0;
+        color_a |= settings->data[1];
+        color_a |= (((unsigned long)settings->data[2]) << 8);
+        color_a |= (((unsigned long)settings->data[3]) << 16);
+        color_b = 0;
+        color_b |= settings->data[4];
+        color_b |= (((unsigned long)settings->data[5]) << 8);
+        color_b |= (((unsigned long)settings->data[6]) << 16);
+        speed = settings->data[7];
+    }
+
+private:
+    uint8_t id = 0;
+    String name = "";
+    CRGB *leds;
+    int rgb_count;
+
+    uint8_t brightness = 255;
+    unsigned long color_a = 0xFF0000;
+    unsigned long color_b = 0x0000FF;
+    uint8_t speed = 8;
+
+    uint16_t offset = 0;
+    uint16_t step;
+    bool drawn = false;
+};
+
+class BytecodeAnimation : public IAnimation
+{
+public:
+    BytecodeAnimation(struct CRGB *targetArray, int RGBCount)
+    {
+        leds = targetArray;
+        rgb_count = RGBCount;
+        currentPalette = RainbowColors_p;
+    }
+
+    void ResetSettings() override
+    {
+        brightness = 255;
+        paletteID = 0;
+        currentPalette = RainbowColors_p;
+    }
+
+    void RestartAnimation() override
+    {
+        FastLED.setBrightness(brightness);
+    }
+
+    bool Update(unsigned long tick) override
+    {
+        if(vm.getLength() == 0) return false;
+        vm.run(leds, rgb_count, tick, currentPalette);
+
+        if(FastLED.getBrightness() != brightness) {
+            FastLED.setBrightness(brightness);
+        }
+        return true;
+    }
+
+    // Program is verified before it is accepted
+    bool SetProgram(const uint8_t* code, uint8_t length)
+    {
+        return vm.load(code, length);
+    }
+
+    BytecodeVM* GetVM()
+    {
+        return &vm;
+    }
+
+    bool UpdateSetting(int index, unsigned long value) override
+    {
+        switch(index)
+        {
+            case 0: // Palette ID
+                if(value > 255) return false;
+                paletteID = (uint8_t)value;
+                currentPalette = PaletteAnimation::GetPalette(paletteID);
+                break;
+            case 1: // Brightness
+                if(value > 255) return false;
+                brightness = (uint8_t)value;
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    int GetSetting(int index) override
+    {
+        switch(index)
+        {
+            case 0: return paletteID;
+            case 1: return brightness;
+            case 2: return vm.getLength();
+            case 3: return vm.getOps();
+            default: return -1;
+        }
+    }
+
+    String GetAvailableSettings() override
+    {
+        return "0: Palette ID (0=Rainbow, 1=Party, 2=Ocean, 3=Forest, 4=Heat, 5=Lava, 6=Matrix)\n1: Brightness\n2: Program length (read only)\n3: Instructions per pixel (read only)";
+    }
+
+    String GetName() override
+    {
+        return name;
+    }
+
+    // The program itself does not fit into data[] and is stored under its own key, see AnimationManager::saveProgram
+    void getAnimationSetting(AnimationSetting* settings) override
+    {
+        settings->id = id;
+        settings->type = BYTECODE;
+
+        memset(settings->name, 0, sizeof(settings->name));
+        int len = name.length();
+        if (len > 13) len = 13;
+        memcpy(settings->name, name.c_str(), len);
+
+        settings->data[0] = brightness;
+        settings->data[1] = paletteID;
+        settings->data[2] = vm.getLength();
+        settings->data[3] = vm.getOps();
+    }
+
+    void applyAnimationSetting(AnimationSetting* settings) override
+    {
+        id = settings->id;
+        name = String(settings->name, strnlen(settings->name, 13));
+
+        brightness = settings->data[0];
+        paletteID = settings->data[1];
+        currentPalette = PaletteAnimation::GetPalette(paletteID);
+    }
+
+private:
+    uint8_t id = 0;
+    String name = "";
+    CRGB *leds;
+    int rgb_count;
+
+    CRGBPalette16 currentPalette;
+    BytecodeVM vm;
+
+    uint8_t brightness = 255;
+    uint8_t paletteID = 0;
+};
+
+class AnimationManager
+{
+    public: 
+        AnimationManager(struct CRGB *targetArray_, int RGBCount_, Preferences& storage)
+        {
+            leds = targetArray_;
+            rgb_count = RGBCount_;
+            _storage = storage;
+        }
+
+        void begin()
+        {
+            memset(animations, 0, sizeof(animations));
+            animation_count = createAnimationsFromStorage();
+        }
+
+        ~AnimationManager(){};
+
+        // Animations the firmware looks up by name
+        static const char* getDefaultAnimationName(int i)
+        {
+            static const char* const names[DEFAULT_ANIMATION_COUNT] = { "OFF", "RED", "SWITCH_BLINK" };
+            return names[i];
+        }
+
+        // Creates the default animations that are missing, with save=false they are only created in memory
+        void ensureDefaultAnimations(bool save = true)
+        {
+            for(int i = 0; i < DEFAULT_ANIMATION_COUNT; i++)
+            {
+                if(getAnimationIndex(getDefaultAnimationName(i)) != -1) continue;
+                AnimationSetting* settings;
+                if(i == 0) settings = createSettingsStaticColor(0, 255, getDefaultAnimationName(i));
+                else if(i == 1) settings = createSettingsStaticColor(0xFF0000, 255, getDefaultAnimationName(i));
+                else settings = createSettingsBlink(0xFF0000, 0, 8, 255, getDefaultAnimationName(i));
+                createAnimation(settings, save);
+                delete settings;
+            }
+        }
+
+        int getAnimationIndex(String name)
+        {
+            int i = 0;
+            while(i < 100)
+            {
+                if (animations[i] != nullptr && name == animations[i]->GetName())break;
+                i++;
+            }
+            //Serial.println(i);
+            if(i < 100)return i;
+            else return -1;
+        }
+
+        IAnimation* getAnimation(int index)
+        {
+            if(index < 0 || index >= 100)return nullptr;
+            else return animations[index];
+        }
+
+        IAnimation* getAnimationByName(String name)
+        {
+            int id = getAnimationIndex(name);
+            if(id==-1)return nullptr;
+            else return animations[id];
+        }
+        
+        // code/length hand over the program of a BYTECODE animation, otherwise it is loaded from storage
+        int createAnimation(AnimationSetting* settings, bool save, const uint8_t* code = nullptr, uint8_t length = 0)
+        {
+            if(settings == nullptr)return -1;
+
+            int i = 0;
+            // Animations from storage keep their slot, so "a<id>" and "p<id>" stay valid
+            if(!save && settings->id < 100 && animations[settings->id] == nullptr) i = settings->id;
+            else while(i<100&&animations[i]!=nullptr) i++;
+            if (i>=100) return -2;
+
+            IAnimation* animation = nullptr;
+            if(settings->type==STATIC_COLOR)
+            {
+                animation = new StaticColorAnimation(leds, rgb_count);
+            }
+            else if(settings->type==BLINK)
+            {
+                animation = new BlinkAnimation(leds, rgb_count);
+            }
+            else if(settings->type == PALETTE)
+            {
+                animation = new PaletteAnimation(leds, rgb_count);
+            }
+            else if(settings->type == BYTECODE)
+            {
+                animation = new BytecodeAnimation(leds, rgb_count);
+            }
+            else if(settings->type == COMET)
+            {
+                animation = new CometAnimation(leds, rgb_count);
+            }
+            else if(settings->type == TWINKLE)
+            {
+                animation = new TwinkleAnimation(leds, rgb_count);
+            }
+            else if(settings->type == WAVE)
+            {
+                animation = new WaveAnimation(leds, rgb_count);
+            }
+            else if(settings->type == GRADIENT)
+            {
+                animation = new GradientAnimation(leds, rgb_count);
+            }
+            else return -3;
+            settings->id = i;
+            animation->applyAnimationSetting(settings);
+            if(settings->type == BYTECODE && !(code != nullptr ? ((BytecodeAnimation*)animation)->SetProgram(code, length) : loadProgram((BytecodeAnimation*)animation, i)))
+            {
+                delete animation;
+                return -4;
+            }
+            if(save)saveAnimation(settings);
+            animations[i]=animation;
+            animation_count++;
+            return i;
+        }
+
+        int createAnimation(AnimationSetting* settings)
+        {
+            return createAnimation(settings, true);
+        }
+
+        // Verifies the program, stores it under "p<id>" and creates the animation for it
+        int createBytecodeAnimation(AnimationSetting* settings, const uint8_t* code, uint8_t length)
+        {
+            if(settings == nullptr)return -1;
+            uint8_t ops = 0;
+            if(BytecodeVM::verify(code, length, &ops) != VM_OK) return -4;
+
+            int i = 0;
+            while(i<100&&animations[i]!=nullptr) i++;
+            if (i>=100) return -2;
+
+            saveProgram(i, code, length);
+            settings->data[2] = length;
+            settings->data[3] = ops;
+            return createAnimation(settings, true);
+        }
+
+        void saveProgram(int id, const uint8_t* code, uint8_t length)
+        {
+            _storage.begin("anim_data");
+            String key = "p" + String(id);
+            _storage.putBytes(key.c_str(), code, length);
+            _storage.end();
+        }
+
+        bool loadProgram(BytecodeAnimation* animation, int id)
+        {
+            uint8_t code[VM_MAX_PROGRAM];
+            String key = "p" + String(id);
+            _storage.begin("anim_data", true);
+            size_t len = _storage.getBytes(key.c_str(), code, sizeof(code));
+            _storage.end();
+            if(len == 0) return false;
+            return animation->SetProgram(code, (uint8_t)len);
+        }
+        void saveAnimation(AnimationSetting* settings)
+        {
+            _storage.begin("anim_data");
+            String key = "a"+ String(settings->id);
+            _storage.putBytes(key.c_str(),settings,sizeof(AnimationSetting));
+            _storage.end();
+        }
+
+        bool saveAnimationIndex(int id)
+        {
+            if(id < 0 || id >= 100)return false;
+            if (animations[id] == nullptr) return false;
+            AnimationSetting settings;
+            animations[id]->getAnimationSetting(&settings);
+            saveAnimation(&settings);
+            return true;
+        }
+
+        void deleteAnimation(int id)
+        {
+            if(id < 0 || id >= 100)return;
+            String key = "a" + String(id);
+            _storage.begin("anim_data", false);
+            _storage.remove(key.c_str()); 
+            key = "p" + String(id);
+            _storage.remove(key.c_str());
+            _storage.end();
+            delete animations[id];
+            animations[id]=nullptr;
+            animation_count--;
+        }
+
+        int createAnimationsFromStorage()
+        {
+            String key = "";
+            int found = 0;
+            for (int i = 0; i < 100; i++)
+            {
+                key = "a" + String(i);
+                AnimationSetting tempSettings;
+                _storage.begin("anim_data", false);
+                size_t len = _storage.getBytes(key.c_str(), &tempSettings, sizeof(AnimationSetting));
+                _storage.end();
+                if (len == sizeof(AnimationSetting)) 
+                {   
+                    tempSettings.id = i;
+                    if(createAnimation(&tempSettings, false) >= 0) found++;
+                }
+            }
+            return found;
+        }
+
+        AnimationSetting* createSettingsStaticColor(unsigned long color, uint8_t brightness, String name)
+        {
+            if (name.length()>13)return nullptr;
+            AnimationSetting* settings = new AnimationSetting();
+            settings->type = STATIC_COLOR;
+            memcpy(settings->name, name.c_str(), name.length());
+            settings->data[0] = brightness;
+            settings->data[1] = (uint8_t)(color & 0xFF);
+            settings->data[2] = (uint8_t)((color >> 8) & 0xFF);
+            settings->data[3] = (uint8_t)((color >> 16) & 0xFF);
+            return settings;
+        }
+
+        AnimationSetting* createSettingsBlink(unsigned long color_on, unsigned long color_off, uint8_t cycle_ticks, uint8_t brightness, String name)
+        {
+            if (name.length()>13)return nullptr;
+            AnimationSetting* settings = new AnimationSetting();
+            settings->type = BLINK;
+            memcpy(settings->name, name.c_str(), name.length());
+            settings->data[0] = brightness;
+            settings->data[1] = (uint8_t)(color_on & 0xFF);
+            settings->data[2] = (uint8_t)((color_on >> 8) & 0xFF);
+            settings->data[3] = (uint8_t)((color_on >> 16) & 0xFF);
+            settings->data[4] = (uint8_t)(color_off & 0xFF);
             settings->data[5] = (uint8_t)((color_off >> 8) & 0xFF);
             settings->data[6] = (uint8_t)((color_off >> 16) & 0xFF);
             settings->data[7] = (uint8_t)cycle_ticks;
@@ -617,12 +1423,352 @@ class AnimationManager
             return settings;
         }
 
+        AnimationSetting* createSettingsBytecode(uint8_t paletteID, uint8_t brightness, String name)
+        {
+            if (name.length() > 13) return nullptr;
+
+            AnimationSetting* settings = new AnimationSetting();
+            settings->type = BYTECODE;
+            memset(settings->name, 0, sizeof(settings->name));
+            memcpy(settings->name, name.c_str(), name.length());
+            settings->data[0] = brightness;
+            settings->data[1] = paletteID;
+            return settings;
+        }
+
+        AnimationSetting* createSettingsComet(unsigned long color, uint8_t speed, uint8_t fade, uint8_t brightness, String name)
+        {
+            if (name.length() > 13) return nullptr;
+
+            AnimationSetting* settings = new AnimationSetting();
+            settings->type = COMET;
+            memset(settings->name, 0, sizeof(settings->name));
+            memcpy(settings->name, name.c_str(), name.length());
+            settings->data[0] = brightness;
+            settings->data[1] = (uint8_t)(color & 0xFF);
+            settings->data[2] = (uint8_t)((color >> 8) & 0xFF);
+            settings->data[3] = (uint8_t)((color >> 16) & 0xFF);
+            settings->data[4] = speed;
+            settings->data[5] = fade;
+            return settings;
+        }
+
+        AnimationSetting* createSettingsTwinkle(unsigned long color, uint8_t density, uint8_t fade, uint8_t brightness, String name)
+        {
+            if (name.length() > 13) return nullptr;
+
+            AnimationSetting* settings = new AnimationSetting();
+            settings->type = TWINKLE;
+            memset(settings->name, 0, sizeof(settings->name));
+            memcpy(settings->name, name.c_str(), name.length());
+            settings->data[0] = brightness;
+            settings->data[1] = (uint8_t)(color & 0xFF);
+            settings->data[2] = (uint8_t)((color >> 8) & 0xFF);
+            settings->data[3] = (uint8_t)((color >> 16) & 0xFF);
+            settings->data[4] = density;
+            settings->data[5] = fade;
+            return settings;
+        }
+
+        AnimationSetting* createSettingsWave(uint8_t paletteID, uint8_t speed, uint8_t wavelength, uint8_t brightness, String name)
+        {
+            if (name.length() > 13) return nullptr;
+
+            AnimationSetting* settings = new AnimationSetting();
+            settings->type = WAVE;
+            memset(settings->name, 0, sizeof(settings->name));
+            memcpy(settings->name, name.c_str(), name.length());
+            settings->data[0] = brightness;
+            settings->data[1] = paletteID;
+            settings->data[2] = speed;
+            settings->data[3] = wavelength;
+            return settings;
+        }
+
+        AnimationSetting* createSettingsGradient(unsigned long color_a, unsigned long color_b, uint8_t speed, uint8_t brightness, String name)
+        {
+            if (name.length() > 13) return nullptr;
+
+            AnimationSetting* settings = new AnimationSetting();
+            settings->type = GRADIENT;
+            memset(settings->name, 0, sizeof(settings->name));
+            memcpy(settings->name, name.c_str(), name.length());
+            settings->data[0] = brightness;
+            settings->data[1] = (uint8_t)(color_a & 0xFF);
+            settings->data[2] = (uint8_t)((color_a >> 8) & 0xFF);
+            settings->data[3] = (uint8_t)((color_a >> 16) & 0xFF);
+            settings->data[4] = (uint8_t)(color_b & 0xFF);
+            settings->data[5] = (uint8_t)((color_b >> 8) & 0xFF);
+            settings->data[6] = (uint8_t)((color_b >> 16) & 0xFF);
+            settings->data[7] = speed;
+            return settings;
+        }
+
         int getAnimationCount()
         {
             return animation_count;
         }
+
+        // Writes all animations as one JSON array to out, data and program as hex:
+        // [{"t":TYPE,"n":"NAME","d":"DATA"[,"p":"PROGRAM"]},...]
+        // Every entry is built in a small stack buffer and written at once, nothing scales with the
+        // number of animations. With out == nullptr only the length is computed, e.g. for an MQTT header.
+        unsigned long exportCatalog(Print* out)
+        {
+            char entry[CATALOG_ENTRY_SIZE];
+            unsigned long total = 2;
+            bool first = true;
+            if(out != nullptr) out->write((const uint8_t*)"[", 1);
+            for(int i = 0; i < 100; i++)
+            {
+                if(animations[i] == nullptr) continue;
+                AnimationSetting settings;
+                memset(&settings, 0, sizeof(settings)); //animations only fill the data bytes they use
+                animations[i]->getAnimationSetting(&settings);
+
+                int len = snprintf(entry, sizeof(entry), "%s{\"t\":%d,\"n\":\"", first ? "" : ",", settings.type);
+                for(int c = 0; c < 13 && settings.name[c] != 0; c++)
+                {
+                    if(settings.name[c] == '"' || settings.name[c] == '\\') catalogAppend(entry, sizeof(entry), len, "\\", 1);
+                    catalogAppend(entry, sizeof(entry), len, &settings.name[c], 1);
+                }
+
+                // Trailing zero bytes are left out, import fills them in again
+                int data_len = sizeof(settings.data);
+                while(data_len > 0 && settings.data[data_len - 1] == 0) data_len--;
+                catalogAppend(entry, sizeof(entry), len, "\",\"d\":\"", 7);
+                catalogAppendHex(entry, sizeof(entry), len, settings.data, data_len);
+
+                if(settings.type == BYTECODE)
+                {
+                    BytecodeVM* vm = ((BytecodeAnimation*)animations[i])->GetVM();
+                    catalogAppend(entry, sizeof(entry), len, "\",\"p\":\"", 7);
+                    catalogAppendHex(entry, sizeof(entry), len, vm->getCode(), vm->getLength());
+                }
+                catalogAppend(entry, sizeof(entry), len, "\"}", 2);
+
+                if(out != nullptr) out->write((const uint8_t*)entry, len);
+                total += len;
+                first = false;
+            }
+            if(out != nullptr) out->write((const uint8_t*)"]", 1);
+            return total;
+        }
+
+        // Replaces all animations with a catalog from exportCatalog() and commits it to storage in one session,
+        // together with the default animations the catalog lacks.
+        // The whole catalog is checked first, nothing changes if any entry is invalid.
+        // Returns the number of imported animations, -2 too many, -3 unknown type, -4 invalid program, -5 syntax error,
+        // -6 duplicate name
+        int importCatalog(const char* json)
+        {
+            if(json == nullptr) return -5;
+            int count = parseCatalog(json, false);
+            if(count < 0) return count;
+
+            for(int i = 0; i < 100; i++)
+            {
+                delete animations[i];
+                animations[i] = nullptr;
+            }
+            animation_count = 0;
+            parseCatalog(json, true);
+            ensureDefaultAnimations(false);
+
+            _storage.begin("anim_data", false);
+            _storage.clear();
+            for(int i = 0; i < 100; i++)
+            {
+                if(animations[i] == nullptr) continue;
+                AnimationSetting settings;
+                memset(&settings, 0, sizeof(settings)); //animations only fill the data bytes they use
+                animations[i]->getAnimationSetting(&settings);
+                String key = "a" + String(i);
+                _storage.putBytes(key.c_str(), &settings, sizeof(AnimationSetting));
+                if(settings.type == BYTECODE)
+                {
+                    BytecodeVM* vm = ((BytecodeAnimation*)animations[i])->GetVM();
+                    key = "p" + String(i);
+                    _storage.putBytes(key.c_str(), vm->getCode(), vm->getLength());
+                }
+            }
+            _storage.end();
+            return count;
+        }
     
     private:
+        static bool catalogAppend(char* buffer, int size, int& len, const char* text, int text_len)
+        {
+            if(len + text_len >= size) return false;
+            memcpy(buffer + len, text, text_len);
+            len += text_len;
+            buffer[len] = 0;
+            return true;
+        }
+
+        static bool catalogAppendHex(char* buffer, int size, int& len, const uint8_t* bytes, int count)
+        {
+            static const char digits[] = "0123456789abcdef";
+            if(len + count * 2 >= size) return false;
+            for(int i = 0; i < count; i++)
+            {
+                buffer[len++] = digits[bytes[i] >> 4];
+                buffer[len++] = digits[bytes[i] & 0x0F];
+            }
+            buffer[len] = 0;
+            return true;
+        }
+
+        static const char* catalogSkipSpace(const char* p)
+        {
+            while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+            return p;
+        }
+
+        // Reads a quoted string with \" and \\ escapes, returns the position after it or nullptr
+        static const char* catalogString(const char* p, char* out, int size, int* out_len)
+        {
+            if(*p != '"') return nullptr;
+            p++;
+            int len = 0;
+            while(*p != '"')
+            {
+                if(*p == 0) return nullptr;
+                if(*p == '\\') p++;
+                if(*p == 0 || len >= size - 1) return nullptr;
+                out[len++] = *p++;
+            }
+            out[len] = 0;
+            if(out_len != nullptr) *out_len = len;
+            return p + 1;
+        }
+
+        static int catalogHex(const char* hex, int hex_len, uint8_t* out, int max_len)
+        {
+            if(hex_len % 2 != 0 || hex_len / 2 > max_len) return -1;
+            for(int i = 0; i < hex_len; i++)
+            {
+                char c = hex[i];
+                uint8_t nibble;
+                if(c >= '0' && c <= '9') nibble = c - '0';
+                else if(c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+                else if(c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+                else return -1;
+                if(i % 2 == 0) out[i / 2] = nibble << 4;
+                else out[i / 2] |= nibble;
+            }
+            return hex_len / 2;
+        }
+
+        // With apply=false only checks the catalog, with apply=true creates the animations (without saving them)
+        int parseCatalog(const char* p, bool apply)
+        {
+            int count = 0;
+            int defaults = 0;
+            const char* names[100]; //where each entry's name starts, to find duplicates without copying the names
+            p = catalogSkipSpace(p);
+            if(*p++ != '[') return -5;
+            p = catalogSkipSpace(p);
+            if(*p == ']') return 0;
+
+            while(true)
+            {
+                AnimationSetting settings;
+                memset(&settings, 0, sizeof(settings));
+                uint8_t code[VM_MAX_PROGRAM];
+                int code_len = 0;
+                bool has_type = false;
+                bool has_name = false;
+                const char* name = nullptr;
+
+                p = catalogSkipSpace(p);
+                if(*p++ != '{') return -5;
+                while(true)
+                {
+                    p = catalogSkipSpace(p);
+                    if(*p == '}') { p++; break; }
+
+                    char key[4];
+                    p = catalogString(p, key, sizeof(key), nullptr);
+                    if(p == nullptr) return -5;
+                    p = catalogSkipSpace(p);
+                    if(*p++ != ':') return -5;
+                    p = catalogSkipSpace(p);
+
+                    if(strcmp(key, "t") == 0)
+                    {
+                        char* end = nullptr;
+                        long type = strtol(p, &end, 10);
+                        if(end == p || type < 0 || type > 255) return -5;
+                        settings.type = (uint8_t)type;
+                        has_type = true;
+                        p = end;
+                    }
+                    else if(strcmp(key, "n") == 0)
+                    {
+                        int len = 0;
+                        name = p;
+                        p = catalogString(p, settings.name, 14, &len);
+                        if(p == nullptr || len == 0) return -5;
+                        has_name = true;
+                    }
+                    else if(strcmp(key, "d") == 0 || strcmp(key, "p") == 0)
+                    {
+                        char hex[VM_MAX_PROGRAM * 2 + 1];
+                        int len = 0;
+                        p = catalogString(p, hex, sizeof(hex), &len);
+                        if(p == nullptr) return -5;
+                        if(key[0] == 'd' && catalogHex(hex, len, settings.data, sizeof(settings.data)) < 0) return -5;
+                        if(key[0] == 'p' && (code_len = catalogHex(hex, len, code, VM_MAX_PROGRAM)) < 0) return -4;
+                    }
+                    else return -5;
+
+                    p = catalogSkipSpace(p);
+                    if(*p == ',') p++;
+                    else if(*p != '}') return -5;
+                }
+
+                if(!has_type || !has_name) return -5;
+                if(count >= 100) return -2;
+                if(!apply)
+                {
+                    for(int i = 0; i < count; i++)
+                    {
+                        char other[14];
+                        catalogString(names[i], other, sizeof(other), nullptr);
+                        if(strcmp(other, settings.name) == 0) return -6;
+                    }
+                    names[count] = name;
+                    for(int i = 0; i < DEFAULT_ANIMATION_COUNT; i++)
+                    {
+                        if(strcmp(settings.name, getDefaultAnimationName(i)) == 0) defaults++;
+                    }
+                }
+                if(settings.type < STATIC_COLOR || settings.type > GRADIENT) return -3;
+                if(settings.type == BYTECODE)
+                {
+                    uint8_t ops = 0;
+                    if(BytecodeVM::verify(code, code_len, &ops) != VM_OK) return -4;
+                    settings.data[2] = code_len;
+                    settings.data[3] = ops;
+                }
+                if(apply)
+                {
+                    settings.id = count;
+                    createAnimation(&settings, false, code, code_len);
+                }
+                count++;
+
+                p = catalogSkipSpace(p);
+                if(*p == ',') { p++; continue; }
+                if(*p == ']') break;
+                return -5;
+            }
+            // the missing default animations are created as well and need slots
+            if(!apply && count + DEFAULT_ANIMATION_COUNT - defaults > 100) return -2;
+            return count;
+        }
+
         IAnimation* animations[100];
         CRGB *leds;
         int rgb_count = 0;
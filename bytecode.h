@@ -0,0 +1,290 @@
+#pragma once
+#include <FastLED.h>
+#include "lookup_tables.h"
+
+/*
+Small stack machine for uploadable per-pixel RGB programs.
+
+A program runs once for every pixel of a frame and has to emit the colour of
+that pixel with PALETTE, HSV or RGB. Values on the stack are 16 bit, 8 bit
+values are treated as fractions of 255 (like FastLED), FMUL multiplies 8.8
+fixed point numbers. There are no jumps, so a verified program always executes
+exactly the same instructions for every pixel and the worst-case cost of a
+frame is known before the program runs. The cost is weighted per opcode
+(vm_opcost), NOISE or PALETTE are far more expensive than ADD.
+
+Opcode           Operand   Stack
+END                        end of program
+PUSH             imm8      -> n
+PUSH16           imm16 LE  -> n
+INDEX                      -> pixel index
+TIME                       -> frame tick (lower 16 bit)
+COUNT                      -> number of pixels
+DUP / SWAP / DROP
+LOAD / STORE     reg       registers are cleared at the start of every frame
+ADD SUB MUL AND XOR MIN MAX                         a b -> a op b
+FMUL                       a b -> (a*b) >> 8
+SCALE8 QADD8 QSUB8         a b -> 8 bit result
+SHR / SHL        bits      a -> a >> bits / a << bits
+SIN8 COS8 TRI8             a -> 8 bit wave of (a & 0xFF)
+NOISE                      x y -> inoise8(x, y)
+RAND8                      -> random8()
+PALETTE                    index brightness -> pixel from palette
+HSV                        h s v -> pixel
+RGB                        r g b -> pixel
+*/
+
+#ifndef RGB_COUNT
+#define RGB_COUNT 211
+#endif
+
+#define VM_MAX_PROGRAM 64
+#define VM_STACK_SIZE 8
+#define VM_REGISTERS 4
+#define VM_FRAME_BUDGET 72000 //max weighted cycles per frame (all pixels): 2 ms at 48 MHz less a 4/3 margin while vm_opcost is uncalibrated
+
+#define VM_OK 0
+#define VM_ERR_LENGTH -1
+#define VM_ERR_OPCODE -2
+#define VM_ERR_OPERAND -3
+#define VM_ERR_UNDERFLOW -4
+#define VM_ERR_OVERFLOW -5
+#define VM_ERR_NO_OUTPUT -6
+#define VM_ERR_NO_END -7
+#define VM_ERR_BUDGET -8
+
+enum VmOpcode : uint8_t
+{
+    OP_END = 0x00,
+    OP_PUSH = 0x01,
+    OP_PUSH16 = 0x02,
+    OP_INDEX = 0x03,
+    OP_TIME = 0x04,
+    OP_COUNT = 0x05,
+    OP_DUP = 0x06,
+    OP_SWAP = 0x07,
+    OP_DROP = 0x08,
+    OP_LOAD = 0x09,
+    OP_STORE = 0x0A,
+    OP_ADD = 0x10,
+    OP_SUB = 0x11,
+    OP_MUL = 0x12,
+    OP_FMUL = 0x13,
+    OP_SCALE8 = 0x14,
+    OP_SHR = 0x15,
+    OP_SHL = 0x16,
+    OP_AND = 0x17,
+    OP_XOR = 0x18,
+    OP_MIN = 0x19,
+    OP_MAX = 0x1A,
+    OP_QADD8 = 0x1B,
+    OP_QSUB8 = 0x1C,
+    OP_SIN8 = 0x20,
+    OP_COS8 = 0x21,
+    OP_TRI8 = 0x22,
+    OP_NOISE = 0x23,
+    OP_RAND8 = 0x24,
+    OP_PALETTE = 0x30,
+    OP_HSV = 0x31,
+    OP_RGB = 0x32,
+    OP_COUNT_ALL = 0x33
+};
+
+// Opcode table for the verifier: bit 7 valid, bit 6 writes pixel,
+// bits 4-5 operand bytes, bits 2-3 pops, bits 0-1 pushes.
+#define VM_OP(operands, pops, pushes) (0x80 | ((operands) << 4) | ((pops) << 2) | (pushes))
+#define VM_OUT(pops) (VM_OP(0, pops, 0) | 0x40)
+
+static const uint8_t vm_opinfo[OP_COUNT_ALL] = {
+    VM_OP(0, 0, 0), VM_OP(1, 0, 1), VM_OP(2, 0, 1), VM_OP(0, 0, 1),         // 0x00
+    VM_OP(0, 0, 1), VM_OP(0, 0, 1), VM_OP(0, 1, 2), VM_OP(0, 2, 2),
+    VM_OP(0, 1, 0), VM_OP(1, 0, 1), VM_OP(1, 1, 0), 0,
+    0, 0, 0, 0,
+    VM_OP(0, 2, 1), VM_OP(0, 2, 1), VM_OP(0, 2, 1), VM_OP(0, 2, 1),         // 0x10
+    VM_OP(0, 2, 1), VM_OP(1, 1, 1), VM_OP(1, 1, 1), VM_OP(0, 2, 1),
+    VM_OP(0, 2, 1), VM_OP(0, 2, 1), VM_OP(0, 2, 1), VM_OP(0, 2, 1),
+    VM_OP(0, 2, 1), 0, 0, 0,
+    VM_OP(0, 1, 1), VM_OP(0, 1, 1), VM_OP(0, 1, 1), VM_OP(0, 2, 1),         // 0x20
+    VM_OP(0, 0, 1), 0, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0, 0,
+    VM_OUT(2), VM_OUT(3), VM_OUT(3)                                         // 0x30
+};
+
+// Cortex-M4 cycles per opcode including the dispatch. These are estimates from the FastLED
+// implementations (inoise8, ColorFromPalette with blending, hsv2rgb_rainbow) and not calibrated on
+// the board yet; the host bench already disagrees with their ratios by about a third, hence the
+// margin in VM_FRAME_BUDGET. To calibrate, create programs that are made mostly of one opcode with
+// 'rgb new vm' and compare the measured against the weighted figure that 'rgb bench NAME' prints.
+static const uint16_t vm_opcost[OP_COUNT_ALL] = {
+    4, 8, 10, 8,            // 0x00
+    8, 8, 8, 10,
+    6, 10, 10, 0,
+    0, 0, 0, 0,
+    8, 8, 10, 12,           // 0x10
+    12, 8, 8, 8,
+    8, 10, 10, 10,
+    10, 0, 0, 0,
+    10, 10, 12, 250,        // 0x20
+    20, 0, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0, 0,
+    120, 80, 12             // 0x30
+};
+
+class BytecodeVM
+{
+    public:
+        BytecodeVM()
+        {
+            initLookupTables();
+        }
+
+        // Checks a program without running it. On success ops is set to the
+        // number of instructions executed per pixel and cost to their weighted cycles.
+        static int verify(const uint8_t* code, uint8_t length, uint8_t* ops, uint16_t* cost = nullptr)
+        {
+            if(code == nullptr || length == 0 || length > VM_MAX_PROGRAM) return VM_ERR_LENGTH;
+
+            int depth = 0;
+            int count = 0;
+            long cycles = vm_opcost[OP_END];
+            bool output = false;
+            uint8_t pc = 0;
+            while(pc < length)
+            {
+                uint8_t op = code[pc];
+                if(op >= OP_COUNT_ALL || !(vm_opinfo[op] & 0x80)) return VM_ERR_OPCODE;
+                if(op == OP_END) break;
+
+                uint8_t info = vm_opinfo[op];
+                uint8_t operands = (info >> 4) & 0x03;
+                if(pc + operands >= length) return VM_ERR_OPERAND;
+                if((op == OP_LOAD || op == OP_STORE) && code[pc + 1] >= VM_REGISTERS) return VM_ERR_OPERAND;
+                if((op == OP_SHR || op == OP_SHL) && code[pc + 1] > 15) return VM_ERR_OPERAND;
+
+                depth -= (info >> 2) & 0x03;
+                if(depth < 0) return VM_ERR_UNDERFLOW;
+                depth += info & 0x03;
+                if(depth > VM_STACK_SIZE) return VM_ERR_OVERFLOW;
+                if(info & 0x40) output = true;
+
+                count++;
+                cycles += vm_opcost[op];
+                pc += 1 + operands;
+            }
+            if(pc >= length) return VM_ERR_NO_END;
+            if(!output) return VM_ERR_NO_OUTPUT;
+            if(cycles * RGB_COUNT > VM_FRAME_BUDGET) return VM_ERR_BUDGET;
+            if(ops != nullptr) *ops = count + 1; //END counts as instruction
+            if(cost != nullptr) *cost = (uint16_t)cycles;
+            return VM_OK;
+        }
+
+        static const char* errorText(int error)
+        {
+            switch(error)
+            {
+                case VM_OK: return "OK";
+                case VM_ERR_LENGTH: return "Program empty or too long";
+                case VM_ERR_OPCODE: return "Unknown opcode";
+                case VM_ERR_OPERAND: return "Missing or invalid operand";
+                case VM_ERR_UNDERFLOW: return "Stack underflow";
+                case VM_ERR_OVERFLOW: return "Stack overflow";
+                case VM_ERR_NO_OUTPUT: return "Program never writes a pixel";
+                case VM_ERR_NO_END: return "Missing END";
+                case VM_ERR_BUDGET: return "Too expensive per frame";
+                default: return "Unknown error";
+            }
+        }
+
+        bool load(const uint8_t* code, uint8_t length)
+        {
+            uint8_t count = 0;
+            uint16_t cycles = 0;
+            if(verify(code, length, &count, &cycles) != VM_OK) return false;
+            memcpy(program, code, length);
+            program_length = length;
+            ops = count;
+            cost = cycles;
+            return true;
+        }
+
+        uint8_t getLength() { return program_length; }
+        const uint8_t* getCode() { return program; }
+        uint8_t getOps() { return ops; }
+        uint16_t getCost() { return cost; }
+        // Weighted worst-case cycles of one frame
+        unsigned long getFrameCost(int pixels) { return (unsigned long)cost * pixels; }
+
+        // Runs the program for every pixel. Only call after a successful load().
+        void run(CRGB* leds, int count, unsigned long tick, const CRGBPalette16& palette)
+        {
+            if(program_length == 0) return;
+
+            uint16_t regs[VM_REGISTERS] = {0};
+            uint16_t stack[VM_STACK_SIZE];
+            uint16_t time = (uint16_t)tick;
+
+            for(int i = 0; i < count; i++)
+            {
+                uint16_t* sp = stack;
+                const uint8_t* pc = program;
+                uint16_t a, b;
+                bool running = true;
+                while(running)
+                {
+                    switch(*pc++)
+                    {
+                        case OP_END: running = false; break;
+                        case OP_PUSH: *sp++ = *pc++; break;
+                        case OP_PUSH16: *sp++ = pc[0] | (pc[1] << 8); pc += 2; break;
+                        case OP_INDEX: *sp++ = (uint16_t)i; break;
+                        case OP_TIME: *sp++ = time; break;
+                        case OP_COUNT: *sp++ = (uint16_t)count; break;
+                        case OP_DUP: *sp = sp[-1]; sp++; break;
+                        case OP_SWAP: a = sp[-1]; sp[-1] = sp[-2]; sp[-2] = a; break;
+                        case OP_DROP: sp--; break;
+                        case OP_LOAD: *sp++ = regs[*pc++]; break;
+                        case OP_STORE: regs[*pc++] = *--sp; break;
+                        case OP_ADD: b = *--sp; sp[-1] += b; break;
+                        case OP_SUB: b = *--sp; sp[-1] -= b; break;
+                        case OP_MUL: b = *--sp; sp[-1] = (uint16_t)((uint32_t)sp[-1] * b); break;
+                        case OP_FMUL: b = *--sp; sp[-1] = (uint16_t)(((uint32_t)sp[-1] * b) >> 8); break;
+                        case OP_SCALE8: b = *--sp; sp[-1] = scale8((uint8_t)sp[-1], (uint8_t)b); break;
+                        case OP_SHR: sp[-1] >>= *pc++; break;
+                        case OP_SHL: sp[-1] <<= *pc++; break;
+                        case OP_AND: b = *--sp; sp[-1] &= b; break;
+                        case OP_XOR: b = *--sp; sp[-1] ^= b; break;
+                        case OP_MIN: b = *--sp; if(b < sp[-1]) sp[-1] = b; break;
+                        case OP_MAX: b = *--sp; if(b > sp[-1]) sp[-1] = b; break;
+                        case OP_QADD8: b = *--sp; sp[-1] = qadd8((uint8_t)sp[-1], (uint8_t)b); break;
+                        case OP_QSUB8: b = *--sp; sp[-1] = qsub8((uint8_t)sp[-1], (uint8_t)b); break;
+                        case OP_SIN8: sp[-1] = sine8_lut[(uint8_t)sp[-1]]; break;
+                        case OP_COS8: sp[-1] = sine8_lut[(uint8_t)(sp[-1] + 64)]; break;
+                        case OP_TRI8: sp[-1] = triangle8((uint8_t)sp[-1]); break;
+                        case OP_NOISE: b = *--sp; sp[-1] = inoise8(sp[-1], b); break;
+                        case OP_RAND8: *sp++ = random8(); break;
+                        case OP_PALETTE:
+                            b = *--sp; a = *--sp;
+                            leds[i] = ColorFromPalette(palette, (uint8_t)a, (uint8_t)b, LINEARBLEND);
+                            break;
+                        case OP_HSV:
+                            sp -= 3;
+                            leds[i] = CHSV((uint8_t)sp[0], (uint8_t)sp[1], (uint8_t)sp[2]);
+                            break;
+                        case OP_RGB:
+                            sp -= 3;
+                            leds[i] = CRGB((uint8_t)sp[0], (uint8_t)sp[1], (uint8_t)sp[2]);
+                            break;
+                    }
+                }
+            }
+        }
+
+    private:
+        uint8_t program[VM_MAX_PROGRAM];
+        uint8_t program_length = 0;
+        uint8_t ops = 0;
+        uint16_t cost = 0;
+};
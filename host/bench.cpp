@@ -0,0 +1,211 @@
+/*
+Host benchmark for the animation core. Runs animations.h, the power limiter and
+the output stage against the shims in shim/, so regressions show up without
+flashing the board. Times are host times, compare them between commits on the
+same machine. Allocation counts match the board, see shim/Arduino.h. The
+allocations of whole serial/MQTT commands are counted by the simulator, which
+runs the real handleRgbCommand(): ./build/sim --allocations
+
+Build and run: make -C host run
+*/
+#include <Arduino.h>
+#include <new>
+#include <chrono>
+#include "animations.h"
+#include "power_limiter.h"
+#include "output_stage.h"
+
+void* operator new(size_t size)
+{
+    host_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static CRGB leds[RGB_COUNT];
+static CRGB rgb_output[RGB_COUNT];
+static Preferences prefs;
+
+static unsigned long long nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// AnimationManager never frees its animations, the benchmark creates many managers
+static void freeAnimations(AnimationManager& manager)
+{
+    for (int i = 0; i < 100; i++) delete manager.getAnimation(i);
+}
+
+static void fillManager(AnimationManager& manager, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        AnimationSetting* settings = manager.createSettingsStaticColor(0x102030 * i, 255, "anim" + String(i));
+        manager.createAnimation(settings);
+        delete settings;
+    }
+}
+
+static IAnimation* create(AnimationManager& manager, AnimationSetting* settings)
+{
+    int index = manager.createAnimation(settings);
+    delete settings;
+    return manager.getAnimation(index);
+}
+
+static IAnimation* createVM(AnimationManager& manager, const char* name, const uint8_t* code, uint8_t length)
+{
+    AnimationSetting* settings = manager.createSettingsBytecode(0, 255, name);
+    int index = manager.createBytecodeAnimation(settings, code, length);
+    delete settings;
+    return manager.getAnimation(index);
+}
+
+// Every pass replays the same frames with the same random seed, so a frame's minimum over the passes
+// is its cost without scheduler noise, the largest of these is the slowest frame. Both columns are host
+// times and only meaningful relative to each other on the same machine.
+static void benchUpdate(IAnimation* animation, const char* label)
+{
+    const int frames = 2000;
+    const int passes = 7;
+    static unsigned long long best[frames];
+
+    unsigned long long total = 0;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        fill_solid(leds, RGB_COUNT, CRGB(0, 0, 0));
+        random16_set_seed(1337);
+        animation->RestartAnimation();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            unsigned long long start = nowNs();
+            animation->Update(frame);
+            unsigned long long duration = nowNs() - start;
+            total += duration;
+            if (pass == 0 || duration < best[frame]) best[frame] = duration;
+        }
+    }
+
+    unsigned long long worst = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        if (best[frame] > worst) worst = best[frame];
+    }
+    printf("  %-12s %8llu ns avg %8llu ns slowest frame\n", label, total / (frames * passes), worst);
+}
+
+static void benchAnimations()
+{
+    printf("Update() per frame, %d LEDs\n", RGB_COUNT);
+    Preferences::resetStore();
+    AnimationManager manager(leds, RGB_COUNT, prefs);
+    manager.begin();
+
+    // palette(index * 3 + (time << 2), 255)
+    const uint8_t rainbow[] = { OP_INDEX, OP_PUSH, 3, OP_MUL, OP_TIME, OP_SHL, 2, OP_ADD, OP_PUSH, 255, OP_PALETTE, OP_END };
+    // grey noise(index << 4, time << 3)
+    const uint8_t noise[] = { OP_INDEX, OP_SHL, 4, OP_TIME, OP_SHL, 3, OP_NOISE, OP_DUP, OP_DUP, OP_RGB, OP_END };
+
+    benchUpdate(create(manager, manager.createSettingsStaticColor(0xFF8000, 255, "static")), "static");
+    benchUpdate(create(manager, manager.createSettingsBlink(0xFF0000, 0, 8, 255, "blink")), "blink");
+    benchUpdate(create(manager, manager.createSettingsPalette(0, 10, 3, 255, "palette")), "palette");
+    benchUpdate(create(manager, manager.createSettingsComet(0xFF8000, 64, 40, 255, "comet")), "comet");
+    benchUpdate(create(manager, manager.createSettingsTwinkle(0xFFFFFF, 80, 20, 255, "twinkle")), "twinkle");
+    benchUpdate(create(manager, manager.createSettingsWave(0, 16, 32, 255, "wave")), "wave");
+    benchUpdate(create(manager, manager.createSettingsGradient(0xFF0000, 0x0000FF, 8, 255, "gradient")), "gradient");
+
+    IAnimation* vm = createVM(manager, "vm rainbow", rainbow, sizeof(rainbow));
+    benchUpdate(vm, "vm rainbow");
+    printf("  %-12s %8d instructions, %d weighted cycles per pixel\n", "", vm->GetSetting(3), ((BytecodeAnimation*)vm)->GetVM()->getCost());
+    vm = createVM(manager, "vm noise", noise, sizeof(noise));
+    benchUpdate(vm, "vm noise");
+    printf("  %-12s %8d instructions, %d weighted cycles per pixel\n", "", vm->GetSetting(3), ((BytecodeAnimation*)vm)->GetVM()->getCost());
+
+    freeAnimations(manager);
+}
+
+static void benchOutput()
+{
+    const int frames = 5000;
+    printf("Output path per frame\n");
+    for (int i = 0; i < RGB_COUNT; i++) leds[i] = CRGB(i, 255 - i, i * 3);
+
+    PowerLimiter limiter(3000);
+    volatile uint8_t sink = 0;
+    unsigned long long start = nowNs();
+    for (int frame = 0; frame < frames; frame++) sink = limiter.apply(leds, RGB_COUNT, 255 - (frame & 1));
+    (void)sink;
+    printf("  %-12s %8llu ns avg\n", "power", (nowNs() - start) / frames);
+
+    OutputStage stage;
+    const char* labels[3] = { "copy", "dither", "gamma+dither" };
+    for (int mode = 0; mode < 3; mode++)
+    {
+        stage.setDither(mode >= 1);
+        stage.setGamma(mode == 2);
+        start = nowNs();
+        for (int frame = 0; frame < frames; frame++) stage.render(leds, rgb_output, RGB_COUNT, 10);
+        printf("  %-12s %8llu ns avg\n", labels[mode], (nowNs() - start) / frames);
+    }
+}
+
+static void benchLookup()
+{
+    const int calls = 20000;
+    const int sizes[3] = { 4, 50, 100 };
+    printf("getAnimationIndex (last animation / unknown name)\n");
+    for (int s = 0; s < 3; s++)
+    {
+        Preferences::resetStore();
+        AnimationManager manager(leds, RGB_COUNT, prefs);
+        manager.begin();
+        fillManager(manager, sizes[s]);
+
+        String last = "anim" + String(sizes[s] - 1);
+        String unknown = "missing";
+        volatile int sink = 0;
+        unsigned long long start = nowNs();
+        for (int i = 0; i < calls; i++) sink += manager.getAnimationIndex(last);
+        unsigned long long hit = (nowNs() - start) / calls;
+        start = nowNs();
+        for (int i = 0; i < calls; i++) sink += manager.getAnimationIndex(unknown);
+        unsigned long long miss = (nowNs() - start) / calls;
+        printf("  %3d animations %8llu ns %8llu ns\n", sizes[s], hit, miss);
+        freeAnimations(manager);
+    }
+}
+
+static void benchBoot()
+{
+    const int sizes[3] = { 4, 50, 100 };
+    printf("createAnimationsFromStorage (boot)\n");
+    for (int s = 0; s < 3; s++)
+    {
+        Preferences::resetStore();
+        AnimationManager writer(leds, RGB_COUNT, prefs);
+        writer.begin();
+        fillManager(writer, sizes[s]);
+        freeAnimations(writer);
+
+        AnimationManager manager(leds, RGB_COUNT, prefs);
+        unsigned long allocations = host_allocations;
+        unsigned long long start = nowNs();
+        manager.begin();
+        unsigned long long duration = nowNs() - start;
+        printf("  %3d animations %8llu ns %6lu allocations\n", sizes[s], duration, host_allocations - allocations);
+        freeAnimations(manager);
+    }
+}
+
+int main()
+{
+    benchAnimations();
+    benchOutput();
+    benchLookup();
+    benchBoot();
+    return 0;
+}
@@ -0,0 +1,241 @@
+#pragma once
+// Host shim for the parts of the Arduino core used by the animation code.
+// String keeps its text in a heap buffer like the Arduino core does (no small
+// string optimisation), so allocation counts on the host match the board.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#ifndef F_CPU
+#define F_CPU 48000000UL
+#endif
+
+#define HEX 16
+#define DEC 10
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+
+// Counts every heap allocation made through String and operator new
+extern unsigned long host_allocations;
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Pins, random and Serial are only implemented by the simulator (sim/platform.cpp)
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+int analogRead(int pin);
+void attachInterrupt(int pin, void (*isr)(), int mode);
+void detachInterrupt(int pin);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+class String
+{
+    public:
+        String(const char* cstr = "") { copy(cstr, cstr ? strlen(cstr) : 0); }
+        String(const char* cstr, unsigned int length) { copy(cstr, length); }
+        String(const String& str) { copy(str.buffer, str.len); }
+        String(String&& str) : buffer(str.buffer), capacity(str.capacity), len(str.len) { str.buffer = nullptr; str.capacity = str.len = 0; }
+        explicit String(char c) { char buf[2] = { c, 0 }; copy(buf, 1); }
+        String(int value, unsigned char base = DEC) { fromLong(value, base); }
+        String(unsigned int value, unsigned char base = DEC) { fromULong(value, base); }
+        String(long value, unsigned char base = DEC) { fromLong(value, base); }
+        String(unsigned long value, unsigned char base = DEC) { fromULong(value, base); }
+        String(unsigned char value, unsigned char base = DEC) { fromULong(value, base); }
+        String(float value, unsigned char decimals = 2) { fromDouble(value, decimals); }
+        String(double value, unsigned char decimals = 2) { fromDouble(value, decimals); }
+        ~String() { free(buffer); }
+
+        String& operator=(const String& rhs) { if (this != &rhs) copy(rhs.buffer, rhs.len); return *this; }
+        String& operator=(String&& rhs)
+        {
+            if (this != &rhs) { free(buffer); buffer = rhs.buffer; capacity = rhs.capacity; len = rhs.len; rhs.buffer = nullptr; rhs.capacity = rhs.len = 0; }
+            return *this;
+        }
+        String& operator=(const char* cstr) { copy(cstr, cstr ? strlen(cstr) : 0); return *this; }
+
+        explicit operator bool() const { return buffer != nullptr; }
+        unsigned int length() const { return len; }
+        const char* c_str() const { return buffer ? buffer : ""; }
+        char charAt(unsigned int index) const { return index < len ? buffer[index] : 0; }
+        char operator[](unsigned int index) const { return charAt(index); }
+
+        bool equals(const char* cstr) const { return strcmp(c_str(), cstr ? cstr : "") == 0; }
+        bool operator==(const String& rhs) const { return len == rhs.len && equals(rhs.c_str()); }
+        bool operator==(const char* rhs) const { return equals(rhs); }
+        bool operator!=(const String& rhs) const { return !(*this == rhs); }
+        bool operator!=(const char* rhs) const { return !equals(rhs); }
+
+        bool concat(const char* cstr, unsigned int length)
+        {
+            if (length == 0) return true;
+            if (!reserve(len + length)) return false;
+            memcpy(buffer + len, cstr, length);
+            len += length;
+            buffer[len] = 0;
+            return true;
+        }
+        bool concat(const String& str) { return concat(str.c_str(), str.len); }
+        bool concat(const char* cstr) { return cstr ? concat(cstr, strlen(cstr)) : false; }
+        bool concat(char c) { return concat(&c, 1); }
+        bool concat(int value) { return concat(String(value)); }
+        bool concat(unsigned long value) { return concat(String(value)); }
+        bool concat(long value) { return concat(String(value)); }
+
+        template<typename T> String& operator+=(const T& rhs) { concat(rhs); return *this; }
+
+        friend String operator+(const String& lhs, const String& rhs) { String s(lhs); s.concat(rhs); return s; }
+        friend String operator+(const String& lhs, const char* rhs) { String s(lhs); s.concat(rhs); return s; }
+        friend String operator+(const char* lhs, const String& rhs) { String s(lhs); s.concat(rhs); return s; }
+        friend String operator+(const String& lhs, char c) { String s(lhs); s.concat(c); return s; }
+        friend String operator+(const String& lhs, int v) { String s(lhs); s.concat(v); return s; }
+        friend String operator+(const String& lhs, long v) { String s(lhs); s.concat(v); return s; }
+        friend String operator+(const String& lhs, unsigned long v) { String s(lhs); s.concat(v); return s; }
+
+        bool startsWith(const String& prefix) const { return prefix.len <= len && strncmp(c_str(), prefix.c_str(), prefix.len) == 0; }
+        bool endsWith(const String& suffix) const { return suffix.len <= len && strcmp(c_str() + len - suffix.len, suffix.c_str()) == 0; }
+        int indexOf(char c, unsigned int from = 0) const
+        {
+            if (from >= len) return -1;
+            const char* p = strchr(buffer + from, c);
+            return p ? (int)(p - buffer) : -1;
+        }
+        int indexOf(const String& str, unsigned int from = 0) const
+        {
+            if (from >= len) return -1;
+            const char* p = strstr(buffer + from, str.c_str());
+            return p ? (int)(p - buffer) : -1;
+        }
+        int indexOf(const char* str, unsigned int from = 0) const { return indexOf(String(str), from); }
+        String substring(unsigned int from) const { return substring(from, len); }
+        String substring(unsigned int from, unsigned int to) const
+        {
+            if (from > to) { unsigned int t = from; from = to; to = t; }
+            if (from >= len) return String();
+            if (to > len) to = len;
+            return String(buffer + from, to - from);
+        }
+        void trim()
+        {
+            if (len == 0) return;
+            unsigned int b = 0, e = len;
+            while (b < e && isspace((unsigned char)buffer[b])) b++;
+            while (e > b && isspace((unsigned char)buffer[e - 1])) e--;
+            len = e - b;
+            memmove(buffer, buffer + b, len);
+            buffer[len] = 0;
+        }
+        void remove(unsigned int index, unsigned int count)
+        {
+            if (index >= len) return;
+            if (count > len - index) count = len - index;
+            memmove(buffer + index, buffer + index + count, len - index - count);
+            len -= count;
+            buffer[len] = 0;
+        }
+        long toInt() const { return strtol(c_str(), nullptr, 10); }
+        float toFloat() const { return strtof(c_str(), nullptr); }
+        void toUpperCase() { for (unsigned int i = 0; i < len; i++) buffer[i] = (char)toupper((unsigned char)buffer[i]); }
+        void toLowerCase() { for (unsigned int i = 0; i < len; i++) buffer[i] = (char)tolower((unsigned char)buffer[i]); }
+        bool reserve(unsigned int size)
+        {
+            if (buffer && capacity >= size) return true;
+            char* grown = (char*)realloc(buffer, size + 1);
+            if (grown == nullptr) return false;
+            host_allocations++;
+            if (buffer == nullptr) grown[0] = 0;
+            buffer = grown;
+            capacity = size;
+            return true;
+        }
+
+    private:
+        void copy(const char* cstr, unsigned int length)
+        {
+            if (!reserve(length)) return;
+            if (length) memcpy(buffer, cstr, length);
+            len = length;
+            buffer[len] = 0;
+        }
+        void fromULong(unsigned long value, unsigned char base)
+        {
+            char buf[34];
+            if (base == HEX) snprintf(buf, sizeof(buf), "%lx", value);
+            else snprintf(buf, sizeof(buf), "%lu", value);
+            copy(buf, strlen(buf));
+        }
+        void fromLong(long value, unsigned char base)
+        {
+            if (base != DEC) { fromULong((unsigned long)value, base); return; }
+            char buf[34];
+            snprintf(buf, sizeof(buf), "%ld", value);
+            copy(buf, strlen(buf));
+        }
+        void fromDouble(double value, unsigned char decimals)
+        {
+            char buf[48];
+            snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+            copy(buf, strlen(buf));
+        }
+
+        char* buffer = nullptr;
+        unsigned int capacity = 0;
+        unsigned int len = 0;
+};
+
+class Print
+{
+    public:
+        virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+        size_t write(uint8_t c) { return write(&c, 1); }
+        virtual ~Print() {}
+
+        size_t print(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+        size_t print(const String& str) { return write((const uint8_t*)str.c_str(), str.length()); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+        size_t print(int value, int base = DEC) { return print((long)value, base); }
+        size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+        size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+        size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+        size_t print(double value, int digits = 2) { return print(String(value, (unsigned char)digits)); }
+
+        size_t println() { return print("\r\n"); }
+        template<typename T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+        template<typename T> size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+class HardwareSerial : public Print
+{
+    public:
+        void begin(unsigned long baud) {}
+        int available();
+        int read();
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+        operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,254 @@
+#pragma once
+// Host shim for the subset of FastLED used by the animation code. The math
+// helpers follow FastLED's integer definitions so that per-pixel work costs
+// roughly what it does on the board; palettes and colour conversion are
+// close approximations, good enough for benchmarks and traces.
+#include <Arduino.h>
+
+typedef uint8_t fract8;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) { return (uint8_t)(((uint16_t)i * (1 + (uint16_t)scale)) >> 8); }
+inline uint8_t scale8_video(uint8_t i, fract8 scale) { return (uint8_t)((((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0)); }
+inline uint16_t scale16by8(uint16_t i, fract8 scale) { return (uint16_t)(((uint32_t)i * (1 + (uint32_t)scale)) >> 8); }
+inline uint16_t scale16(uint16_t i, uint16_t scale) { return (uint16_t)(((uint32_t)i * (1 + (uint32_t)scale)) >> 16); }
+inline uint8_t qadd8(uint8_t i, uint8_t j) { unsigned int t = i + j; return t > 255 ? 255 : (uint8_t)t; }
+inline uint8_t qsub8(uint8_t i, uint8_t j) { int t = i - j; return t < 0 ? 0 : (uint8_t)t; }
+inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 frac)
+{
+    return b > a ? (uint8_t)(a + scale8(b - a, frac)) : (uint8_t)(a - scale8(a - b, frac));
+}
+
+inline uint8_t sin8(uint8_t theta)
+{
+    static const uint8_t b_m16_interleave[] = { 0, 49, 49, 41, 90, 27, 117, 10 };
+    uint8_t offset = theta;
+    if (theta & 0x40) offset = (uint8_t)255 - offset;
+    offset &= 0x3F;
+    uint8_t secoffset = offset & 0x0F;
+    if (theta & 0x40) ++secoffset;
+    uint8_t section = offset >> 4;
+    uint8_t s2 = section * 2;
+    const uint8_t* p = b_m16_interleave + s2;
+    uint8_t b = *p++;
+    uint8_t m16 = *p;
+    uint8_t mx = (m16 * secoffset) >> 4;
+    int8_t y = mx + b;
+    if (theta & 0x80) y = -y;
+    return (uint8_t)(y + 128);
+}
+inline uint8_t cos8(uint8_t theta) { return sin8(theta + 64); }
+
+inline uint8_t ease8InOutQuad(uint8_t i)
+{
+    uint8_t j = i;
+    if (j & 0x80) j = 255 - j;
+    uint8_t jj = scale8(j, j);
+    uint8_t jj2 = jj << 1;
+    if (i & 0x80) jj2 = 255 - jj2;
+    return jj2;
+}
+inline uint8_t ease8InOutCubic(uint8_t i)
+{
+    uint8_t ii = scale8(i, i);
+    uint8_t iii = scale8(ii, i);
+    uint16_t r1 = (3 * (uint16_t)ii) - (2 * (uint16_t)iii);
+    return r1 & 0x100 ? 255 : (uint8_t)r1;
+}
+
+inline uint16_t& fastled_rand16_seed() { static uint16_t seed = 1337; return seed; }
+inline uint8_t random8() { fastled_rand16_seed() = (fastled_rand16_seed() * 2053) + 13849; return (uint8_t)((uint8_t)fastled_rand16_seed() + (uint8_t)(fastled_rand16_seed() >> 8)); }
+inline uint8_t random8(uint8_t lim) { return (uint8_t)((random8() * lim) >> 8); }
+inline uint8_t random8(uint8_t min, uint8_t lim) { return (uint8_t)(random8(lim - min) + min); }
+inline uint16_t random16() { fastled_rand16_seed() = (fastled_rand16_seed() * 2053) + 13849; return fastled_rand16_seed(); }
+inline uint16_t random16(uint16_t lim) { return (uint16_t)(((uint32_t)random16() * lim) >> 16); }
+inline void random16_add_entropy(uint16_t entropy) { fastled_rand16_seed() += entropy; }
+inline void random16_set_seed(uint16_t seed) { fastled_rand16_seed() = seed; }
+
+// Value noise stand-in for FastLED's Perlin noise: same signature, same
+// order of magnitude of work per call.
+inline uint8_t inoise8(uint16_t x, uint16_t y)
+{
+    auto hash = [](uint16_t a, uint16_t b) -> uint8_t {
+        uint32_t h = (uint32_t)a * 374761393u + (uint32_t)b * 668265263u;
+        h = (h ^ (h >> 13)) * 1274126177u;
+        return (uint8_t)(h >> 24);
+    };
+    uint8_t fx = x & 0xFF, fy = y & 0xFF;
+    uint16_t ix = x >> 8, iy = y >> 8;
+    uint8_t top = lerp8by8(hash(ix, iy), hash(ix + 1, iy), fx);
+    uint8_t bottom = lerp8by8(hash(ix, iy + 1), hash(ix + 1, iy + 1), fx);
+    return lerp8by8(top, bottom, fy);
+}
+inline uint8_t inoise8(uint16_t x) { return inoise8(x, 0); }
+
+struct CHSV
+{
+    union { struct { uint8_t h, s, v; }; uint8_t raw[3]; };
+    CHSV() : h(0), s(0), v(0) {}
+    CHSV(uint8_t ih, uint8_t is, uint8_t iv) : h(ih), s(is), v(iv) {}
+};
+
+struct CRGB;
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb);
+
+struct CRGB
+{
+    union { struct { uint8_t r, g, b; }; uint8_t raw[3]; };
+
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+    CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+    CRGB(const CHSV& hsv) { hsv2rgb_rainbow(hsv, *this); }
+
+    uint8_t& operator[](uint8_t x) { return raw[x]; }
+    const uint8_t& operator[](uint8_t x) const { return raw[x]; }
+    bool operator==(const CRGB& rhs) const { return r == rhs.r && g == rhs.g && b == rhs.b; }
+    bool operator!=(const CRGB& rhs) const { return !(*this == rhs); }
+    CRGB& operator+=(const CRGB& rhs) { r = qadd8(r, rhs.r); g = qadd8(g, rhs.g); b = qadd8(b, rhs.b); return *this; }
+    CRGB& nscale8(uint8_t scale) { r = scale8(r, scale); g = scale8(g, scale); b = scale8(b, scale); return *this; }
+    CRGB& nscale8_video(uint8_t scale) { r = scale8_video(r, scale); g = scale8_video(g, scale); b = scale8_video(b, scale); return *this; }
+    CRGB& fadeToBlackBy(uint8_t fade) { return nscale8(255 - fade); }
+
+    enum HTMLColorCode
+    {
+        Black = 0x000000,
+        Blue = 0x0000FF,
+        DarkGreen = 0x006400,
+        Green = 0x008000,
+        Red = 0xFF0000,
+        White = 0xFFFFFF,
+    };
+};
+
+inline void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb)
+{
+    // Piecewise-linear hue wheel; FastLED's rainbow variant has a wider
+    // yellow band, which does not matter for host measurements.
+    uint8_t region = hsv.h / 43;
+    uint8_t rem = (hsv.h - region * 43) * 6;
+    uint8_t p = scale8(hsv.v, 255 - hsv.s);
+    uint8_t q = scale8(hsv.v, 255 - scale8(hsv.s, rem));
+    uint8_t t = scale8(hsv.v, 255 - scale8(hsv.s, 255 - rem));
+    switch (region)
+    {
+        case 0: rgb = CRGB(hsv.v, t, p); break;
+        case 1: rgb = CRGB(q, hsv.v, p); break;
+        case 2: rgb = CRGB(p, hsv.v, t); break;
+        case 3: rgb = CRGB(p, q, hsv.v); break;
+        case 4: rgb = CRGB(t, p, hsv.v); break;
+        default: rgb = CRGB(hsv.v, p, q); break;
+    }
+}
+
+inline CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amountOfP2)
+{
+    return CRGB(lerp8by8(p1.r, p2.r, amountOfP2), lerp8by8(p1.g, p2.g, amountOfP2), lerp8by8(p1.b, p2.b, amountOfP2));
+}
+
+inline void fill_solid(CRGB* leds, int numToFill, const CRGB& color)
+{
+    for (int i = 0; i < numToFill; ++i) leds[i] = color;
+}
+inline void nscale8(CRGB* leds, uint16_t num_leds, uint8_t scale)
+{
+    for (uint16_t i = 0; i < num_leds; ++i) leds[i].nscale8(scale);
+}
+inline void fadeToBlackBy(CRGB* leds, uint16_t num_leds, uint8_t fadeBy) { nscale8(leds, num_leds, 255 - fadeBy); }
+
+inline CRGB HeatColor(uint8_t temperature)
+{
+    uint8_t t192 = scale8_video(temperature, 191);
+    uint8_t heatramp = (t192 & 0x3F) << 2;
+    if (t192 & 0x80) return CRGB(255, 255, heatramp);
+    if (t192 & 0x40) return CRGB(255, heatramp, 0);
+    return CRGB(heatramp, 0, 0);
+}
+
+typedef uint32_t TProgmemRGBPalette16[16];
+
+enum TBlendType { NOBLEND = 0, LINEARBLEND = 1 };
+
+class CRGBPalette16
+{
+    public:
+        CRGB entries[16];
+
+        CRGBPalette16() {}
+        CRGBPalette16(const TProgmemRGBPalette16& rhs) { for (int i = 0; i < 16; ++i) entries[i] = CRGB(rhs[i]); }
+        CRGBPalette16(const CRGB& c1, const CRGB& c2, const CRGB& c3, const CRGB& c4)
+        {
+            // FastLED fills 16 entries as a gradient through the four anchors.
+            const CRGB anchors[4] = { c1, c2, c3, c4 };
+            for (int i = 0; i < 16; ++i)
+            {
+                int pos = i * 3 * 256 / 15;
+                int seg = pos >> 8;
+                if (seg > 2) seg = 2;
+                entries[i] = blend(anchors[seg], anchors[seg + 1], (uint8_t)(pos - seg * 256 > 255 ? 255 : pos - seg * 256));
+            }
+        }
+        CRGBPalette16& operator=(const TProgmemRGBPalette16& rhs) { *this = CRGBPalette16(rhs); return *this; }
+        CRGB& operator[](uint8_t x) { return entries[x]; }
+        const CRGB& operator[](uint8_t x) const { return entries[x]; }
+};
+
+inline CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness = 255, TBlendType blendType = LINEARBLEND)
+{
+    uint8_t hi4 = index >> 4;
+    uint8_t lo4 = index & 0x0F;
+    CRGB entry = pal[hi4];
+    if (blendType == LINEARBLEND && lo4)
+    {
+        const CRGB& next = pal[(hi4 + 1) & 0x0F];
+        entry = blend(entry, next, lo4 << 4);
+    }
+    if (brightness != 255) entry.nscale8_video(brightness);
+    return entry;
+}
+
+extern const TProgmemRGBPalette16 RainbowColors_p;
+extern const TProgmemRGBPalette16 PartyColors_p;
+extern const TProgmemRGBPalette16 OceanColors_p;
+extern const TProgmemRGBPalette16 ForestColors_p;
+extern const TProgmemRGBPalette16 HeatColors_p;
+extern const TProgmemRGBPalette16 LavaColors_p;
+
+#define TypicalLEDStrip 0xFFB0F0
+#define DISABLE_DITHER 0
+#define BINARY_DITHER 1
+#define WS2812B 0
+#define GRB 0
+
+class CLEDController
+{
+    public:
+        CLEDController& setCorrection(uint32_t correction) { return *this; }
+        CRGB* leds = nullptr;
+        int count = 0;
+};
+
+class CFastLED
+{
+    public:
+        template<int CHIPSET, int DATA_PIN, int RGB_ORDER>
+        CLEDController& addLeds(CRGB* data, int nLeds)
+        {
+            controller.leds = data;
+            controller.count = nLeds;
+            return controller;
+        }
+        void setBrightness(uint8_t scale) { brightness = scale; }
+        uint8_t getBrightness() { return brightness; }
+        void setDither(uint8_t ditherMode) { dither = ditherMode; }
+        void show() { show(brightness); }
+        void show(uint8_t scale);
+
+        CLEDController controller;
+        uint8_t brightness = 255;
+        uint8_t dither = BINARY_DITHER;
+        unsigned long shows = 0;
+        // Host only: called with the controller's buffer on every show, used by the simulator
+        void (*on_show)(const CRGB* leds, int count, uint8_t scale) = nullptr;
+};
+
+extern CFastLED FastLED;
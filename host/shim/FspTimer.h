@@ -0,0 +1,35 @@
+#pragma once
+// Host shim for the Renesas FspTimer: the simulator calls the callback from
+// its virtual clock at the configured rate.
+#include <Arduino.h>
+
+#define GPT_TIMER (0)
+#define AGT_TIMER (1)
+
+typedef enum { TIMER_MODE_PERIODIC, TIMER_MODE_ONE_SHOT, TIMER_MODE_PWM } timer_mode_t;
+
+typedef struct
+{
+    uint32_t channel;
+    void const* p_context;
+} timer_callback_args_t;
+
+using GPTimerCbk_f = void(*)(timer_callback_args_t *);
+
+class FspTimer
+{
+    public:
+        bool begin(timer_mode_t mode, uint8_t type, uint8_t channel, float freq_hz, float duty_perc, GPTimerCbk_f cbk = nullptr, void* ctx = nullptr);
+        bool setup_overflow_irq(uint8_t priority = 12) { return true; }
+        bool open() { return true; }
+        bool start();
+        bool stop();
+        void end() { stop(); }
+
+        static int8_t get_available_timer(uint8_t& type, bool force = false) { type = GPT_TIMER; return 0; }
+        static void force_use_of_pwm_reserved_timer() {}
+
+        GPTimerCbk_f callback = nullptr;
+        unsigned long period_us = 0;
+        bool running = false;
+};
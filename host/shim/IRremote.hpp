@@ -0,0 +1,12 @@
+#pragma once
+// Host shim: sent codes are logged by the simulator.
+#include <Arduino.h>
+
+class IRsend
+{
+    public:
+        void begin(uint8_t pin) {}
+        void sendNECRaw(uint32_t data, int_fast8_t repeats);
+};
+
+extern IRsend IrSender;
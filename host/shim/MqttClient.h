@@ -0,0 +1,44 @@
+#pragma once
+// Host shim for ArduinoMqttClient, connected to the simulator's in-process broker.
+#include <Arduino.h>
+#include <WiFiS3.h>
+#include <string>
+#include <vector>
+
+class MqttClient : public Print
+{
+    public:
+        MqttClient(Client& client) {}
+
+        void onMessage(void (*callback)(int)) { on_message = callback; }
+        void setUsernamePassword(const char* user, const char* pass) {}
+        void setId(const String& id) {}
+        int connect(const char* host, uint16_t port);
+        int connected() { return is_connected; }
+        void poll();
+        int subscribe(const char* topic, uint8_t qos = 0);
+
+        int beginMessage(const char* topic, bool retain = false, uint8_t qos = 0, bool dup = false);
+        int beginMessage(const char* topic, unsigned long size, bool retain = false, uint8_t qos = 0, bool dup = false);
+        int endMessage();
+        size_t write(const uint8_t* buffer, size_t size) override;
+        using Print::write;
+
+        String messageTopic() { return String(rx_topic.c_str()); }
+        int available() { return (int)(rx_payload.size() - rx_pos); }
+        int read() { return rx_pos < rx_payload.size() ? (uint8_t)rx_payload[rx_pos++] : -1; }
+
+        // Host only: messages from the broker waiting for poll()
+        void deliver(const std::string& topic, const std::string& payload);
+
+    private:
+        void (*on_message)(int) = nullptr;
+        bool is_connected = false;
+        std::string tx_topic, tx_payload;
+        bool tx_retain = false;
+        size_t tx_limit = 0;
+        bool tx_sized = false;
+        std::string rx_topic, rx_payload;
+        size_t rx_pos = 0;
+        std::vector<std::pair<std::string, std::string>> inbox;
+};
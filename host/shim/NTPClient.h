@@ -0,0 +1,24 @@
+#pragma once
+// Host shim: time starts at a fixed epoch and follows the simulated clock.
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#define SIM_START_EPOCH 1767225600UL //2026-01-01 00:00:00
+
+class NTPClient
+{
+    public:
+        NTPClient(UDP& udp, const char* server, long offset, unsigned long interval) : time_offset(offset) {}
+        void begin() {}
+        bool update() { return true; }
+        unsigned long getEpochTime() { return SIM_START_EPOCH + time_offset + millis() / 1000; }
+        String getFormattedTime()
+        {
+            unsigned long t = getEpochTime();
+            char buf[9];
+            snprintf(buf, sizeof(buf), "%02lu:%02lu:%02lu", (t % 86400) / 3600, (t % 3600) / 60, t % 60);
+            return String(buf);
+        }
+    private:
+        long time_offset;
+};
@@ -0,0 +1,83 @@
+#pragma once
+// Host shim for the UNO R4 Preferences library. All instances share one
+// in-memory store, just like the real class shares the flash partition.
+// The store's own heap use is not counted in host_allocations, the board
+// keeps this data in flash.
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+    public:
+        typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+        bool begin(const char* name, bool readOnly = false)
+        {
+            Uncounted uncounted;
+            current = &store()[name];
+            read_only = readOnly;
+            return true;
+        }
+        void end() { current = nullptr; }
+
+        size_t putBytes(const char* key, const void* value, size_t len)
+        {
+            if (current == nullptr || read_only) return 0;
+            Uncounted uncounted;
+            const uint8_t* bytes = (const uint8_t*)value;
+            (*current)[key].assign(bytes, bytes + len);
+            writes()++;
+            return len;
+        }
+        size_t getBytesLength(const char* key)
+        {
+            if (current == nullptr) return 0;
+            Uncounted uncounted;
+            auto it = current->find(key);
+            return it == current->end() ? 0 : it->second.size();
+        }
+        size_t getBytes(const char* key, void* buf, size_t maxLen)
+        {
+            size_t len = getBytesLength(key);
+            if (len == 0 || len > maxLen) return 0;
+            Uncounted uncounted;
+            memcpy(buf, (*current)[key].data(), len);
+            return len;
+        }
+        bool isKey(const char* key) { return getBytesLength(key) > 0; }
+        bool remove(const char* key)
+        {
+            if (current == nullptr || read_only) return false;
+            Uncounted uncounted;
+            writes()++;
+            return current->erase(key) > 0;
+        }
+        bool clear()
+        {
+            if (current == nullptr || read_only) return false;
+            writes()++;
+            current->clear();
+            return true;
+        }
+
+        // Host only: wipe all namespaces and count flash writes
+        static void resetStore() { store().clear(); writes() = 0; }
+        static unsigned long& writes() { static unsigned long count = 0; return count; }
+
+    private:
+        struct Uncounted
+        {
+            unsigned long saved = host_allocations;
+            ~Uncounted() { host_allocations = saved; }
+        };
+
+        static std::map<std::string, Namespace>& store()
+        {
+            static std::map<std::string, Namespace> namespaces;
+            return namespaces;
+        }
+        Namespace* current = nullptr;
+        bool read_only = false;
+};
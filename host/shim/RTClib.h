@@ -0,0 +1,2 @@
+#pragma once
+// Host shim, the firmware does not use anything from this header.
@@ -0,0 +1,17 @@
+#pragma once
+// Host shim: the simulator reports when the timeout would have reset the board.
+#include <Arduino.h>
+
+class WDTimer
+{
+    public:
+        bool begin(unsigned long timeout_ms) { timeout = timeout_ms; last_refresh = millis(); return true; }
+        void refresh();
+
+        unsigned long timeout = 0;
+        unsigned long last_refresh = 0;
+        unsigned long longest_gap = 0;
+        unsigned long expired = 0;
+};
+
+extern WDTimer WDT;
@@ -0,0 +1,35 @@
+#pragma once
+// Host shim for the UNO R4 WiFi library: always connected, fixed address.
+#include <Arduino.h>
+
+#define WL_CONNECTED 3
+
+class IPAddress
+{
+    public:
+        IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : bytes{ a, b, c, d } {}
+        String toString() const { return String(bytes[0]) + "." + String(bytes[1]) + "." + String(bytes[2]) + "." + String(bytes[3]); }
+    private:
+        uint8_t bytes[4];
+};
+
+class CWifi
+{
+    public:
+        void setDNS(IPAddress dns) {}
+        int begin(const char* ssid, const char* pass) { return WL_CONNECTED; }
+        int status() { return WL_CONNECTED; }
+        IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+};
+
+extern CWifi WiFi;
+
+class Client
+{
+    public:
+        virtual ~Client() {}
+};
+
+class WiFiClient : public Client
+{
+};
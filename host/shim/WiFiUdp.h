@@ -0,0 +1,11 @@
+#pragma once
+// Host shim, NTPClient below never sends anything.
+#include <Arduino.h>
+
+class UDP
+{
+};
+
+class WiFiUDP : public UDP
+{
+};
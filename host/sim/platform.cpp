@@ -0,0 +1,357 @@
+// Simulated UNO R4 board: virtual clock, pins, Serial, RGB timer, watchdog,
+// DHT, IR sender and the MQTT client with its in-process broker.
+#include "sim.h"
+#include <FspTimer.h>
+#include <WDT.h>
+#include <DHT.h>
+#include <IRremote.hpp>
+#include <MqttClient.h>
+#include <WiFiS3.h>
+#include <chrono>
+#include <map>
+#include <vector>
+
+unsigned long host_allocations = 0;
+
+// Buffers of the simulated board live on the host heap, they are not allocations of the firmware
+struct HostOnly
+{
+    unsigned long saved = host_allocations;
+    ~HostOnly() { host_allocations = saved; }
+};
+
+// ===== CLOCK =====
+
+static unsigned long long now_us = 0;
+static FspTimer* rgb_timer = nullptr;
+static unsigned long long timer_deadline = 0;
+
+unsigned long long simNow()
+{
+    return now_us;
+}
+
+void simAdvance(unsigned long long us)
+{
+    unsigned long long target = now_us + us;
+    while (true)
+    {
+        unsigned long long next = target;
+        bool timer_due = rgb_timer != nullptr && rgb_timer->running && timer_deadline <= next;
+        if (timer_due) next = timer_deadline;
+        unsigned long long event = simNextEvent();
+        if (event < now_us) event = now_us;
+        if (event < next) { next = event; timer_due = false; }
+
+        now_us = next;
+        if (timer_due)
+        {
+            timer_deadline += rgb_timer->period_us;
+            auto start = std::chrono::steady_clock::now();
+            timer_callback_args_t args = { 0, nullptr };
+            rgb_timer->callback(&args);
+            simOnTimer(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        if (event <= now_us) simRunDueEvents();
+        if (now_us >= target && !timer_due && event > now_us) break;
+    }
+}
+
+unsigned long micros() { return (unsigned long)now_us; }
+unsigned long millis() { return (unsigned long)(now_us / 1000); }
+void delay(unsigned long ms) { simAdvance((unsigned long long)ms * 1000); }
+void delayMicroseconds(unsigned int us) { simAdvance(us); }
+
+bool FspTimer::begin(timer_mode_t mode, uint8_t type, uint8_t channel, float freq_hz, float duty_perc, GPTimerCbk_f cbk, void* ctx)
+{
+    if (freq_hz <= 0 || cbk == nullptr) return false;
+    callback = cbk;
+    period_us = (unsigned long)(1000000.0f / freq_hz);
+    rgb_timer = this;
+    return true;
+}
+
+bool FspTimer::start()
+{
+    running = true;
+    timer_deadline = now_us + period_us;
+    return true;
+}
+
+bool FspTimer::stop()
+{
+    running = false;
+    return true;
+}
+
+// ===== PINS =====
+
+static int pin_level[64];
+static int pin_analog[64];
+static void (*pin_isr[64])() = { nullptr };
+static int pin_isr_mode[64];
+
+void pinMode(int pin, int mode) {}
+
+int digitalRead(int pin)
+{
+    return (pin >= 0 && pin < 64) ? pin_level[pin] : LOW;
+}
+
+void digitalWrite(int pin, int value)
+{
+    if (pin < 0 || pin >= 64) return;
+    HostOnly host;
+    if (pin_level[pin] != value) simOnOutput("pin " + std::to_string(pin) + (value ? " HIGH" : " LOW"));
+    pin_level[pin] = value;
+}
+
+int analogRead(int pin)
+{
+    return (pin >= 0 && pin < 64) ? pin_analog[pin] : 0;
+}
+
+void attachInterrupt(int pin, void (*isr)(), int mode)
+{
+    if (pin < 0 || pin >= 64) return;
+    pin_isr[pin] = isr;
+    pin_isr_mode[pin] = mode;
+}
+
+void detachInterrupt(int pin)
+{
+    if (pin < 0 || pin >= 64) return;
+    pin_isr[pin] = nullptr;
+}
+
+void simSetPin(int pin, int value)
+{
+    if (pin < 0 || pin >= 64) return;
+    int old = pin_level[pin];
+    pin_level[pin] = value;
+    if (old == value || pin_isr[pin] == nullptr) return;
+    int mode = pin_isr_mode[pin];
+    if (mode == CHANGE || (mode == RISING && value) || (mode == FALLING && !value)) pin_isr[pin]();
+}
+
+int simGetPin(int pin)
+{
+    return digitalRead(pin);
+}
+
+void simSetAnalog(int pin, int value)
+{
+    if (pin >= 0 && pin < 64) pin_analog[pin] = value;
+}
+
+// Deterministic, so runs with the same script are identical
+static unsigned long random_state = 1;
+
+void randomSeed(unsigned long seed) { random_state = seed ? seed : 1; }
+
+long random(long max)
+{
+    if (max <= 0) return 0;
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (long)((random_state >> 16) & 0x7FFF) % max;
+}
+
+long random(long min, long max)
+{
+    return max > min ? min + random(max - min) : min;
+}
+
+// ===== SERIAL =====
+
+HardwareSerial Serial;
+static std::string serial_in;
+static size_t serial_pos = 0;
+static bool serial_echo = true;
+static bool serial_line_start = true;
+
+int HardwareSerial::available()
+{
+    return (int)(serial_in.size() - serial_pos);
+}
+
+int HardwareSerial::read()
+{
+    if (serial_pos >= serial_in.size()) return -1;
+    return (uint8_t)serial_in[serial_pos++];
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    if (!serial_echo) return size;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (buffer[i] == '\r') continue;
+        if (serial_line_start) fputs("[serial] ", stdout);
+        fputc(buffer[i], stdout);
+        serial_line_start = buffer[i] == '\n';
+    }
+    return size;
+}
+
+void simSerialInput(const std::string& text)
+{
+    serial_in.erase(0, serial_pos);
+    serial_pos = 0;
+    serial_in += text;
+}
+
+bool simSerialEcho(bool enabled)
+{
+    bool old = serial_echo;
+    serial_echo = enabled;
+    return old;
+}
+
+// ===== PERIPHERALS =====
+
+CWifi WiFi;
+WDTimer WDT;
+IRsend IrSender;
+
+void WDTimer::refresh()
+{
+    unsigned long gap = millis() - last_refresh;
+    if (gap > longest_gap) longest_gap = gap;
+    if (timeout && gap > timeout) expired++;
+    last_refresh = millis();
+}
+
+static float sim_temperature = 21.0f;
+static float sim_humidity = 45.0f;
+
+void simSetClimate(float temperature, float humidity)
+{
+    sim_temperature = temperature;
+    sim_humidity = humidity;
+}
+
+float DHT::readTemperature() { return sim_temperature; }
+float DHT::readHumidity() { return sim_humidity; }
+
+void IRsend::sendNECRaw(uint32_t data, int_fast8_t repeats)
+{
+    HostOnly host;
+    char buf[32];
+    snprintf(buf, sizeof(buf), "ir 0x%08X", (unsigned)data);
+    simOnOutput(buf);
+}
+
+// ===== MQTT =====
+
+#define MQTT_TX_BUFFER_SIZE 256 //ArduinoMqttClient buffers messages without a known size
+
+struct Subscription
+{
+    MqttClient* client;
+    std::string filter;
+};
+
+static std::vector<Subscription> subscriptions;
+static std::map<std::string, std::string> retained;
+
+static bool topicMatches(const std::string& filter, const std::string& topic)
+{
+    size_t f = 0, t = 0;
+    while (f < filter.size())
+    {
+        if (filter[f] == '#') return true;
+        if (filter[f] == '+')
+        {
+            while (t < topic.size() && topic[t] != '/') t++;
+            f++;
+            continue;
+        }
+        if (t >= topic.size() || filter[f] != topic[t]) return false;
+        f++;
+        t++;
+    }
+    return t == topic.size();
+}
+
+void simBrokerPublish(const std::string& topic, const std::string& payload, bool retain)
+{
+    if (retain) retained[topic] = payload;
+    for (auto& sub : subscriptions)
+    {
+        if (topicMatches(sub.filter, topic)) sub.client->deliver(topic, payload);
+    }
+}
+
+int MqttClient::connect(const char* host, uint16_t port)
+{
+    is_connected = true;
+    return 1;
+}
+
+int MqttClient::subscribe(const char* topic, uint8_t qos)
+{
+    subscriptions.push_back({ this, topic });
+    for (auto& message : retained)
+    {
+        if (topicMatches(topic, message.first)) deliver(message.first, message.second);
+    }
+    return 1;
+}
+
+void MqttClient::deliver(const std::string& topic, const std::string& payload)
+{
+    inbox.push_back({ topic, payload });
+}
+
+void MqttClient::poll()
+{
+    while (!inbox.empty())
+    {
+        rx_topic = inbox.front().first;
+        rx_payload = inbox.front().second;
+        rx_pos = 0;
+        inbox.erase(inbox.begin());
+        if (on_message != nullptr) on_message((int)rx_payload.size());
+    }
+}
+
+int MqttClient::beginMessage(const char* topic, bool retain, uint8_t qos, bool dup)
+{
+    HostOnly host;
+    tx_topic = topic;
+    tx_payload.clear();
+    tx_retain = retain;
+    tx_limit = MQTT_TX_BUFFER_SIZE;
+    tx_sized = false;
+    return 1;
+}
+
+int MqttClient::beginMessage(const char* topic, unsigned long size, bool retain, uint8_t qos, bool dup)
+{
+    beginMessage(topic, retain, qos, dup);
+    tx_limit = size;
+    tx_sized = true;
+    return 1;
+}
+
+size_t MqttClient::write(const uint8_t* buffer, size_t size)
+{
+    HostOnly host;
+    if (tx_payload.size() + size > tx_limit) size = tx_limit - tx_payload.size();
+    tx_payload.append((const char*)buffer, size);
+    return size;
+}
+
+int MqttClient::endMessage()
+{
+    HostOnly host;
+    // The real client has already sent the declared length in the header
+    if (tx_sized && tx_payload.size() != tx_limit)
+    {
+        fprintf(stderr, "mqtt: %s declared %zu bytes but wrote %zu\n", tx_topic.c_str(), tx_limit, tx_payload.size());
+    }
+    SimPublish message = { simNow(), tx_topic, tx_payload, tx_retain };
+    simOnFirmwarePublish(message);
+    simBrokerPublish(tx_topic, tx_payload, tx_retain);
+    return 1;
+}
@@ -0,0 +1,5 @@
+#pragma once
+// Forced include for the sketch: prototypes the Arduino builder would generate.
+#include <Arduino.h>
+
+inline void CheckAnimation();
@@ -0,0 +1,8 @@
+#pragma once
+// Credentials for the simulator, the real secrets.h is not part of the repository.
+#define WIFI_SSID "sim"
+#define WIFI_PASS "sim"
+#define BROKER_HOST_ADRESS "localhost"
+#define BROKER_HOST_PORT 1883
+#define BROKER_USER "sim"
+#define BROKER_PASSWORD "sim"
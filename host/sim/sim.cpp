@@ -0,0 +1,438 @@
+/*
+Whole-firmware simulator. Central_Desk_Controller.ino is compiled unchanged
+against the shims in ../shim and the simulated board in platform.cpp.
+
+  make -C host sim
+  ./host/build/sim [--script FILE] [--trace FILE] [--duration MS] [--loop-us US] [--quiet]
+  ./host/build/sim --allocations
+
+Time is virtual: every loop() iteration costs --loop-us (default 100 us), delay()
+and FastLED.show() (30 us per LED) advance the clock as well, and the RGB timer
+fires from that clock. Runs with the same script are therefore identical, which
+makes the latency numbers reproducible and the traces comparable with cmp.
+
+Script lines are "<ms> <event> <args>", '#' starts a comment:
+  1000 key 1                  key switch (pin 12)
+  1000 switch 0               PC switch (pin 3)
+  1000 button 1               button (pin 2)
+  1000 pc 512                 raw analog value of the PC state pin
+  1000 dht 22.5 40            temperature and humidity
+  1000 mqtt TOPIC PAYLOAD     publish into the broker, e.g. to rgb/command
+  1000 serial rgb set RED     serial input line
+  8000 end                    stop the simulation
+
+Latency is measured from an event to the first visible pixel change and the first
+publish, but only until the next event: later effects are not credited to it.
+"=> LIST" after an event names the effects it is expected to cause, a comma separated
+list of "pixels" and topic suffixes, or "none". Only those are measured then, e.g.
+  4500 button 1 => pixels,rgb/status
+
+--allocations runs setup() with 50 animations in storage and counts the heap allocations
+of single handleRgbCommand() calls, parsing and String handling included. Host side
+buffers of the simulated board are not counted.
+
+Trace format (little endian): "CDCTRACE", u16 version, u16 LED count, then one
+record per FastLED.show(): u32 us since previous record, u8 brightness,
+u16 first changed LED, u16 changed LEDs, then R, G, B of each changed LED.
+*/
+#include "sim.h"
+#include <FastLED.h>
+#include <WDT.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+void setup();
+void loop();
+void handleRgbCommand(String& command);
+extern CRGB leds[];
+
+void* operator new(size_t size)
+{
+    host_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+#define SIM_KEY_PIN 12     //pins from Central_Desk_Controller.ino
+#define SIM_SWITCH_PIN 3
+#define SIM_BUTTON_PIN 2
+#define SIM_PC_PIN A0
+#define SIM_SHOW_US_PER_LED 30
+
+struct Event
+{
+    unsigned long long time_us;
+    std::string kind;
+    std::string args;
+    std::vector<std::string> expect;
+    int line;
+};
+
+// An input event and when its effects became visible, open until the next event
+struct Latency
+{
+    std::string label;
+    unsigned long long time_us;
+    unsigned long long pixels_us = 0;
+    unsigned long long publish_us = 0;
+    std::string publish_topic;
+    bool open = true;
+    bool pixels = true;
+    bool publish = true;
+    std::vector<std::string> topics;    //empty: any topic
+
+    bool expects(const std::string& topic) const
+    {
+        if (!publish) return false;
+        if (topics.empty()) return true;
+        for (auto& suffix : topics)
+        {
+            if (topic.size() >= suffix.size() && topic.compare(topic.size() - suffix.size(), suffix.size(), suffix) == 0) return true;
+        }
+        return false;
+    }
+};
+
+struct Stats
+{
+    unsigned long count = 0;
+    unsigned long long total = 0;
+    unsigned long long worst = 0;
+    void add(unsigned long long value) { count++; total += value; if (value > worst) worst = value; }
+    unsigned long long avg() const { return count ? total / count : 0; }
+};
+
+static std::vector<Event> events;
+static size_t next_event = 0;
+static std::vector<Latency> latencies;
+static std::vector<SimPublish> publishes;
+static std::vector<std::string> outputs;
+static Stats loop_stats, frame_stats;
+static unsigned long shows = 0, changed_shows = 0;
+static unsigned long long end_us = 0;
+
+static std::ofstream trace;
+static unsigned long long last_trace_us = 0;
+static std::vector<CRGB> last_output, last_frame;
+static uint8_t last_scale = 0;
+
+static std::string fmtMs(unsigned long long us)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu.%03llu", us / 1000, us % 1000);
+    return buf;
+}
+
+static void writeLE(unsigned long value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) trace.put((char)((value >> (8 * i)) & 0xFF));
+}
+
+static void onShow(const CRGB* output, int count, uint8_t scale)
+{
+    shows++;
+    if (last_output.empty())
+    {
+        last_output.assign(count, CRGB(0, 0, 0));
+        last_frame.assign(count, CRGB(0, 0, 0));
+        if (trace.is_open())
+        {
+            trace.write("CDCTRACE", 8);
+            writeLE(1, 2);
+            writeLE(count, 2);
+        }
+    }
+
+    int first = count, last = -1;
+    bool visible = scale != last_scale;
+    for (int i = 0; i < count; i++)
+    {
+        if (output[i] != last_output[i])
+        {
+            if (first == count) first = i;
+            last = i;
+            // Dithering moves a channel by one step, anything more is new content
+            for (int c = 0; c < 3; c++)
+            {
+                if (abs((int)output[i][c] - (int)last_output[i][c]) > 1) visible = true;
+            }
+        }
+        if (leds[i] != last_frame[i]) visible = true;
+    }
+
+    if (trace.is_open())
+    {
+        int changed = last >= first ? last - first + 1 : 0;
+        writeLE((unsigned long)(simNow() - last_trace_us), 4);
+        writeLE(scale, 1);
+        writeLE(changed ? first : 0, 2);
+        writeLE(changed, 2);
+        for (int i = first; i <= last; i++)
+        {
+            trace.put((char)output[i].r);
+            trace.put((char)output[i].g);
+            trace.put((char)output[i].b);
+        }
+        last_trace_us = simNow();
+    }
+
+    if (visible)
+    {
+        changed_shows++;
+        for (auto& latency : latencies)
+        {
+            if (latency.open && latency.pixels && latency.pixels_us == 0) latency.pixels_us = simNow();
+        }
+    }
+    std::copy(output, output + count, last_output.begin());
+    std::copy(leds, leds + count, last_frame.begin());
+    last_scale = scale;
+
+    // Sending the data takes the strip's wire time
+    simAdvance((unsigned long long)count * SIM_SHOW_US_PER_LED);
+}
+
+void simOnFirmwarePublish(const SimPublish& message)
+{
+    publishes.push_back(message);
+    for (auto& latency : latencies)
+    {
+        if (latency.open && latency.publish_us == 0 && latency.expects(message.topic))
+        {
+            latency.publish_us = message.time_us;
+            latency.publish_topic = message.topic;
+        }
+    }
+}
+
+void simOnTimer(unsigned long long host_ns)
+{
+    frame_stats.add(host_ns);
+}
+
+void simOnOutput(const std::string& what)
+{
+    outputs.push_back(fmtMs(simNow()) + " ms " + what);
+}
+
+unsigned long long simNextEvent()
+{
+    return next_event < events.size() ? events[next_event].time_us : ~0ULL;
+}
+
+void simRunDueEvents()
+{
+    while (next_event < events.size() && events[next_event].time_us <= simNow())
+    {
+        const Event& event = events[next_event++];
+        for (auto& latency : latencies) latency.open = false;
+        std::istringstream args(event.args);
+        int value = 0;
+        bool input = true;
+
+        if (event.kind == "key" && args >> value) simSetPin(SIM_KEY_PIN, value);
+        else if (event.kind == "switch" && args >> value) simSetPin(SIM_SWITCH_PIN, value);
+        else if (event.kind == "button" && args >> value) simSetPin(SIM_BUTTON_PIN, value);
+        else if (event.kind == "pc" && args >> value) simSetAnalog(SIM_PC_PIN, value);
+        else if (event.kind == "dht")
+        {
+            float temperature = 0, humidity = 0;
+            args >> temperature >> humidity;
+            simSetClimate(temperature, humidity);
+        }
+        else if (event.kind == "mqtt")
+        {
+            std::string topic, payload;
+            args >> topic;
+            std::getline(args >> std::ws, payload);
+            simBrokerPublish(topic, payload, false);
+        }
+        else if (event.kind == "serial") simSerialInput(event.args + "\r\n");
+        else if (event.kind == "end")
+        {
+            end_us = event.time_us;
+            input = false;
+        }
+        else
+        {
+            fprintf(stderr, "script line %d: unknown event '%s'\n", event.line, event.kind.c_str());
+            input = false;
+        }
+
+        if (input)
+        {
+            Latency latency;
+            latency.label = event.kind + " " + event.args;
+            latency.time_us = simNow();
+            for (auto& effect : event.expect)
+            {
+                if (effect != "pixels" && effect != "none") latency.topics.push_back(effect);
+            }
+            latency.pixels = event.expect.empty() || std::find(event.expect.begin(), event.expect.end(), "pixels") != event.expect.end();
+            latency.publish = event.expect.empty() || !latency.topics.empty();
+            latencies.push_back(latency);
+        }
+    }
+}
+
+static bool loadScript(const char* path)
+{
+    std::ifstream file(path);
+    if (!file) return false;
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line))
+    {
+        number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream in(line);
+        double ms;
+        Event event;
+        if (!(in >> ms >> event.kind)) continue;
+        std::getline(in >> std::ws, event.args);
+        size_t expect = event.args.find("=>");
+        if (expect != std::string::npos)
+        {
+            std::istringstream list(event.args.substr(expect + 2));
+            std::string effect;
+            while (std::getline(list >> std::ws, effect, ','))
+            {
+                while (!effect.empty() && (effect.back() == ' ' || effect.back() == '\r')) effect.pop_back();
+                if (!effect.empty()) event.expect.push_back(effect);
+            }
+            event.args.erase(expect);
+        }
+        while (!event.args.empty() && (event.args.back() == '\r' || event.args.back() == ' ')) event.args.pop_back();
+        event.time_us = (unsigned long long)(ms * 1000);
+        event.line = number;
+        events.push_back(event);
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.time_us < b.time_us; });
+    return true;
+}
+
+static void report()
+{
+    printf("\n===== SIMULATION REPORT =====\n");
+    printf("Simulated time:   %s ms\n", fmtMs(simNow()).c_str());
+    printf("Loop iterations:  %lu, host %llu ns avg, %llu ns worst\n", loop_stats.count, loop_stats.avg(), loop_stats.worst);
+    printf("Animation frames: %lu, host %llu ns avg, %llu ns worst (RGBCallback)\n", frame_stats.count, frame_stats.avg(), frame_stats.worst);
+    printf("Shows:            %lu, %lu with visible changes\n", shows, changed_shows);
+    printf("Watchdog:         longest gap %lu ms, %lu expirations\n", WDT.longest_gap, WDT.expired);
+
+    printf("\nLatency (simulated time after the event):\n");
+    for (auto& latency : latencies)
+    {
+        printf("  %10s ms  %-40.40s pixels %12s  publish %12s %s\n", fmtMs(latency.time_us).c_str(), latency.label.c_str(),
+               latency.pixels_us ? ("+" + fmtMs(latency.pixels_us - latency.time_us) + " ms").c_str() : "-",
+               latency.publish_us ? ("+" + fmtMs(latency.publish_us - latency.time_us) + " ms").c_str() : "-",
+               latency.publish_topic.c_str());
+    }
+
+    printf("\nMQTT publishes: %zu\n", publishes.size());
+    for (auto& message : publishes)
+    {
+        printf("  %10s ms  %s = %.60s%s\n", fmtMs(message.time_us).c_str(), message.topic.c_str(), message.payload.c_str(),
+               message.payload.size() > 60 ? "..." : "");
+    }
+    printf("\nOutputs:\n");
+    for (auto& output : outputs) printf("  %s\n", output.c_str());
+}
+
+static unsigned long countCommand(const char* text)
+{
+    String command(text);
+    unsigned long before = host_allocations;
+    handleRgbCommand(command);
+    return host_allocations - before;
+}
+
+static void runAllocations()
+{
+    simSerialEcho(false);
+    setup();
+    char line[64];
+    for (int i = 0; i < 50; i++)
+    {
+        snprintf(line, sizeof(line), "new static anim%d %06X", i, 0x102030 * i);
+        countCommand(line);
+    }
+
+    const char* commands[] = {
+        "set anim42", "list", "setting set anim42 0 00FF00", "new static pink FF00FF", "delete pink", "catalog",
+    };
+    printf("Heap allocations per command (50 animations)\n");
+    for (const char* command : commands) printf("  %-28s %4lu\n", command, countCommand(command));
+}
+
+int main(int argc, char** argv)
+{
+    const char* script = nullptr;
+    const char* trace_path = nullptr;
+    unsigned long long duration_ms = 0;
+    unsigned long loop_us = 100;
+    bool quiet = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--script" && i + 1 < argc) script = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc) trace_path = argv[++i];
+        else if (arg == "--duration" && i + 1 < argc) duration_ms = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--loop-us" && i + 1 < argc) loop_us = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--quiet") quiet = true;
+        else if (arg == "--allocations")
+        {
+            runAllocations();
+            return 0;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--script FILE] [--trace FILE] [--duration MS] [--loop-us US] [--quiet] | --allocations\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (script != nullptr && !loadScript(script))
+    {
+        fprintf(stderr, "Cannot read script %s\n", script);
+        return 1;
+    }
+    if (trace_path != nullptr)
+    {
+        trace.open(trace_path, std::ios::binary);
+        if (!trace)
+        {
+            fprintf(stderr, "Cannot write trace %s\n", trace_path);
+            return 1;
+        }
+    }
+
+    if (duration_ms) end_us = duration_ms * 1000;
+    else if (!events.empty()) end_us = events.back().time_us + 2000000;
+    else end_us = 10000000;
+
+    simSerialEcho(!quiet);
+    FastLED.on_show = onShow;
+
+    setup();
+    while (simNow() < end_us)
+    {
+        auto start = std::chrono::steady_clock::now();
+        loop();
+        loop_stats.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        simAdvance(loop_us);
+    }
+
+    fflush(stdout);
+    report();
+    return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+// Interface between the simulated platform (platform.cpp) and the simulator driver (sim.cpp).
+#include <Arduino.h>
+#include <string>
+
+struct SimPublish
+{
+    unsigned long long time_us;
+    std::string topic;
+    std::string payload;
+    bool retain;
+};
+
+// Virtual clock. Advancing it fires the RGB timer and due script events.
+unsigned long long simNow();
+void simAdvance(unsigned long long us);
+
+// Pins as seen by the firmware. Setting an input with an attached interrupt runs the ISR.
+void simSetPin(int pin, int value);
+int simGetPin(int pin);
+void simSetAnalog(int pin, int value);
+void simSetClimate(float temperature, float humidity);
+void simSerialInput(const std::string& text);
+bool simSerialEcho(bool enabled);
+
+// Broker stand-in: publish from an external client into the broker.
+void simBrokerPublish(const std::string& topic, const std::string& payload, bool retain);
+
+// Hooks into the driver (sim.cpp)
+void simOnFirmwarePublish(const SimPublish& message);
+void simOnTimer(unsigned long long host_ns);
+void simOnOutput(const std::string& what);
+unsigned long long simNextEvent();
+void simRunDueEvents();
@@ -0,0 +1,25 @@
+#pragma once
+#include <FastLED.h>
+
+// Tables shared by the per-pixel animations and the bytecode VM. They are
+// filled once on first use, so a frame only does table lookups.
+static uint8_t sine8_lut[256];   // sin8(i)
+static uint8_t ease8_lut[256];   // ease8InOutCubic(i)
+static bool lookup_tables_ready = false;
+
+static void initLookupTables()
+{
+    if(lookup_tables_ready) return;
+    for(int i = 0; i < 256; i++)
+    {
+        sine8_lut[i] = sin8((uint8_t)i);
+        ease8_lut[i] = ease8InOutCubic((uint8_t)i);
+    }
+    lookup_tables_ready = true;
+}
+
+// 0..255..0 over one period of x
+static inline uint8_t triangle8(uint8_t x)
+{
+    return (x & 0x80) ? (uint8_t)((255 - x) << 1) : (uint8_t)(x << 1);
+}
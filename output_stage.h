@@ -0,0 +1,110 @@
+#pragma once
+#include <FastLED.h>
+
+#define GAMMA 2.2f
+// WS2812B wire time of a frame: 24 bit at 800 kHz per pixel plus the reset latch. FastLED keeps
+// interrupts masked for all of it.
+#define LED_WIRE_US(count) ((unsigned long)(count) * 30 + 50)
+
+/*
+Post-processing between the animation frame buffer and the LEDs.
+Gamma correction maps every channel to an 8.8 fixed point value through a table, brightness is applied
+in 16 bit so dark colours keep their fraction. Dithering adds an ordered threshold that depends on the
+pixel position only, so the fraction shows up as the average over 8 neighbouring pixels. The pattern
+stands still, nothing blinks and no extra shows are needed between animation frames.
+Gamma without dithering would round the dark end of the curve to few coarse steps, so gamma is only
+ever on together with dithering.
+*/
+class OutputStage
+{
+    public:
+        OutputStage()
+        {
+            for(int i = 0; i < 256; i++)
+            {
+                gamma_lut[i] = (uint16_t)(powf(i / 255.0f, GAMMA) * 65280.0f + 0.5f);
+            }
+        }
+
+        // Writes the processed frame to out and returns the brightness FastLED has to use for it
+        uint8_t render(const CRGB* in, CRGB* out, int count, uint8_t brightness)
+        {
+            if(!dither)
+            {
+                memcpy(out, in, count * sizeof(CRGB));
+                return brightness;
+            }
+
+            unsigned long start = micros();
+            // 1D ordered pattern, centred on one half so the average is not biased
+            static const uint8_t bayer8[8] = { 16, 144, 80, 208, 48, 176, 112, 240 };
+            uint16_t scale = (uint16_t)brightness + 1;
+
+            for(int i = 0; i < count; i++)
+            {
+                uint16_t threshold = bayer8[i & 7];
+                const uint8_t* src = in[i].raw;
+                uint8_t* dst = out[i].raw;
+                for(int c = 0; c < 3; c++)
+                {
+                    uint16_t value = gamma ? gamma_lut[src[c]] : (uint16_t)(src[c] << 8);
+                    value = (uint16_t)(((uint32_t)value * scale) >> 8);
+                    dst[c] = (uint8_t)((value + threshold) >> 8);
+                }
+            }
+
+            last_us = micros() - start;
+            if(last_us > max_us) max_us = last_us;
+            return 255;
+        }
+
+        // Channel sums of the frame as it will be shown at full brightness, for the power estimate
+        void sum(const CRGB* in, int count, uint32_t* sum_r, uint32_t* sum_g, uint32_t* sum_b)
+        {
+            uint32_t r = 0, g = 0, b = 0;
+            for(int i = 0; i < count; i++)
+            {
+                if(gamma)
+                {
+                    r += gamma_lut[in[i].r] >> 8;
+                    g += gamma_lut[in[i].g] >> 8;
+                    b += gamma_lut[in[i].b] >> 8;
+                }
+                else
+                {
+                    r += in[i].r;
+                    g += in[i].g;
+                    b += in[i].b;
+                }
+            }
+            *sum_r = r;
+            *sum_g = g;
+            *sum_b = b;
+        }
+
+        // Gamma switches dithering on, dithering off switches gamma off
+        void setGamma(bool enabled)
+        {
+            if(enabled) setDither(true);
+            gamma = enabled;
+        }
+        void setDither(bool enabled)
+        {
+            dither = enabled;
+            if(!enabled) gamma = false;
+            // FastLED's own dithering would fight with ours
+            FastLED.setDither(enabled ? DISABLE_DITHER : BINARY_DITHER);
+        }
+        bool isGamma() { return gamma; }
+        bool isDithering() { return dither; }
+        unsigned long getLastMicros() { return last_us; }
+        unsigned long getMaxMicros() { return max_us; }
+        void resetStats() { max_us = 0; }
+
+    private:
+        uint16_t gamma_lut[256];
+        bool gamma = false;
+        bool dither = false;
+        unsigned long last_us = 0;
+        unsigned long max_us = 0;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <FastLED.h>
+
+// Current draw of one WS2812B channel at full value and of a dark pixel, same figures FastLED uses for its power model
+#define LED_RED_MA 16
+#define LED_GREEN_MA 11
+#define LED_BLUE_MA 15
+#define LED_IDLE_MA 1
+
+#define LIMITER_RELEASE_STEP 4 //brightness steps per frame when the limit is lifted again
+
+/*
+Estimates the current of a frame and caps the brightness to stay within a budget.
+The estimate is one summing pass over the frame buffer, the coefficients are applied once per frame.
+With gamma correction the sums have to be taken after the mapping (OutputStage::sum()), the raw frame
+overestimates everything between black and full.
+Lowering the limit happens immediately, raising it again is slowed down so the strip does not pump
+when the content changes quickly.
+*/
+class PowerLimiter
+{
+    public:
+        PowerLimiter(unsigned long budget_mA)
+        {
+            budget = budget_mA;
+        }
+
+        // Returns the brightness that should be used to show this frame
+        uint8_t apply(const CRGB* leds, int count, uint8_t brightness)
+        {
+            uint32_t sum_r = 0, sum_g = 0, sum_b = 0;
+            for(int i = 0; i < count; i++)
+            {
+                sum_r += leds[i].r;
+                sum_g += leds[i].g;
+                sum_b += leds[i].b;
+            }
+            return apply(sum_r, sum_g, sum_b, count, brightness);
+        }
+
+        // Same with the channel sums of the values that actually reach the strip, see OutputStage::sum()
+        uint8_t apply(uint32_t sum_r, uint32_t sum_g, uint32_t sum_b, int count, uint8_t brightness)
+        {
+            // mA of the frame at full brightness, without the idle current
+            uint32_t content = (sum_r * LED_RED_MA + sum_g * LED_GREEN_MA + sum_b * LED_BLUE_MA) / 255;
+            uint32_t idle = (uint32_t)count * LED_IDLE_MA;
+
+            target = 255;
+            if(budget <= idle) target = 0;
+            else if(content + idle > budget)
+            {
+                target = (uint8_t)(((budget - idle) * 255) / content);
+            }
+
+            if(target < limit) limit = target;
+            else if(target > limit) limit = (target - limit > LIMITER_RELEASE_STEP) ? limit + LIMITER_RELEASE_STEP : target;
+
+            uint8_t output = (brightness < limit) ? brightness : limit;
+            limiting = output < brightness;
+            estimate = idle + ((content * output) >> 8);
+            return output;
+        }
+
+        unsigned long getEstimate() { return estimate; }
+        unsigned long getBudget() { return budget; }
+        void setBudget(unsigned long budget_mA) { budget = budget_mA; }
+        uint8_t getLimit() { return limit; }
+        bool isLimiting() { return limiting; }
+        // True while the limit is still being lifted, the frame has to be shown again to finish the ramp
+        bool isRamping() { return limit < target; }
+
+    private:
+        unsigned long budget;
+        unsigned long estimate = 0;
+        uint8_t limit = 255;
+        uint8_t target = 255;
+        bool limiting = false;
+};
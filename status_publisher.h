@@ -0,0 +1,106 @@
+#pragma once
+#include <Arduino.h>
+
+#define PUBLISHER_MAX_FIELDS 16
+#define PUBLISHER_BURST 5          //publishes that may go out back to back
+#define PUBLISHER_REFILL_MS 200    //after a burst one more publish is allowed per interval
+
+/*
+Change-driven status publishing.
+Whoever owns a piece of state marks its field dirty when the state changes, the main loop only
+asks for due fields while something is marked and publishes the current value of each of them.
+A field is held back until its minimum interval since its last publish has passed, a token bucket
+over all fields limits bursts. Marks that arrive while the field is still waiting are merged into
+that one publish and counted as suppressed.
+markDirty() may be called from interrupt handlers as well as from the loop, every change of the
+shared mask is an atomic read-modify-write (LDREX/STREX on the Cortex-M4) so no mark gets lost.
+*/
+class StatusPublisher
+{
+    public:
+        // Registers a field, interval 0 publishes every change right away
+        void setMinInterval(uint8_t field, unsigned long interval_ms)
+        {
+            min_interval[field] = interval_ms;
+            fields |= (1 << field);
+        }
+
+        void markDirty(uint8_t field)
+        {
+            uint16_t bit = 1 << field;
+            uint16_t before = __atomic_fetch_or(&dirty, bit, __ATOMIC_RELAXED);
+            if(before & bit) __atomic_fetch_add(&suppressed[field], 1, __ATOMIC_RELAXED);
+        }
+
+        // Marks every registered field without counting, e.g. to refresh retained topics after a reconnect
+        void markAll()
+        {
+            __atomic_fetch_or(&dirty, fields, __ATOMIC_RELAXED);
+        }
+
+        bool pending() { return dirty != 0; }
+
+        // Returns the next field that is due and clears its mark, -1 if nothing may be published now.
+        // The caller has to publish the field.
+        int next(unsigned long now)
+        {
+            if(dirty == 0) return -1;
+
+            if(tokens == PUBLISHER_BURST) refill_at = now;
+            while(tokens < PUBLISHER_BURST && now - refill_at >= PUBLISHER_REFILL_MS)
+            {
+                tokens++;
+                refill_at += PUBLISHER_REFILL_MS;
+            }
+
+            for(uint8_t i = 0; i < PUBLISHER_MAX_FIELDS; i++)
+            {
+                uint16_t bit = 1 << i;
+                if(!(dirty & bit)) continue;
+
+                bool due = !(sent & bit) || now - published_at[i] >= min_interval[i];
+                if(!due || tokens == 0)
+                {
+                    // count every mark only once, no matter how often it is looked at while waiting
+                    if(!(held & bit)) delayed[i]++;
+                    held |= bit;
+                    continue;
+                }
+
+                __atomic_fetch_and(&dirty, (uint16_t)~bit, __ATOMIC_RELAXED);
+                held &= ~bit;
+                sent |= bit;
+                tokens--;
+                published_at[i] = now;
+                published[i]++;
+                return i;
+            }
+            return -1;
+        }
+
+        unsigned long getPublished(uint8_t field) { return published[field]; }
+        unsigned long getSuppressed(uint8_t field) { return suppressed[field]; }
+        unsigned long getDelayed(uint8_t field) { return delayed[field]; }
+        void resetStats()
+        {
+            for(uint8_t i = 0; i < PUBLISHER_MAX_FIELDS; i++)
+            {
+                published[i] = 0;
+                suppressed[i] = 0;
+                delayed[i] = 0;
+            }
+        }
+
+    private:
+        volatile uint16_t dirty = 0;
+        uint16_t fields = 0;
+        uint16_t held = 0;
+        uint16_t sent = 0;
+        uint8_t tokens = PUBLISHER_BURST;
+        unsigned long refill_at = 0;
+        unsigned long min_interval[PUBLISHER_MAX_FIELDS] = {0};
+        unsigned long published_at[PUBLISHER_MAX_FIELDS] = {0};
+        unsigned long published[PUBLISHER_MAX_FIELDS] = {0};
+        volatile unsigned long suppressed[PUBLISHER_MAX_FIELDS] = {0};
+        unsigned long delayed[PUBLISHER_MAX_FIELDS] = {0};
+};